@@ -0,0 +1,395 @@
+/*
+ * autotune.c
+ *
+ * Searches blocked transpose variants for the one that causes the fewest
+ * misses on a given cache. Every combination of tile height, tile width,
+ * tile order, order inside a tile and diagonal handling is run against its
+ * own simulated cache, spread over worker threads. Each variant really
+ * transposes the matrix and is checked against correctTrans.
+ *
+ * A and B are given fixed simulated addresses laid out like test-trans's
+ * globals, so results don't depend on the host allocator or thread.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "cachelab.h"
+#include "cache.h"
+#include "packed.h"
+
+// Simulated location of A; B follows MATRIX_STRIDE ints later
+#define A_BASE 0x10000000UL
+#define MATRIX_STRIDE (256 * 256)
+
+// Tile edges that are tried, capped at the matrix dimension
+static const int tile_sizes[] = { 1, 2, 4, 8, 12, 16, 24, 32, 64 };
+#define NUM_TILE_SIZES (int)(sizeof(tile_sizes) / sizeof(tile_sizes[0]))
+
+// One point in the search space
+typedef struct variant {
+	int tile_rows;      /* rows of A per tile */
+	int tile_cols;      /* columns of A per tile */
+	int tiles_by_col;   /* walk tiles column by column instead of by row */
+	int inner_by_col;   /* walk each tile column by column */
+	int defer_diagonal; /* copy the diagonal element last */
+	int index;          /* generation order, breaks ties */
+	trans_func_t result;
+	char description[96];
+} variant_t;
+
+// State of one simulated run
+typedef struct run {
+	Set *cache;
+	int hits, misses, evictions;
+} run_t;
+
+// Shared between worker threads
+static variant_t *variants;
+static int num_variants;
+static int next_variant = 0;
+static pthread_mutex_t next_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int M, N;
+static int set_bits = 5, lines_per_set = 1, block_bits = 5;
+static int packed = 0;  /* caches in the compact encoding, -p */
+static mem_addr b_base;
+static int *source;   /* A, shared and read only */
+static int *expected; /* correctTrans(A) */
+
+
+
+/**
+ * Prints out a reminder of how to run the program.
+ *
+ * @param executable_name String containing the name of the executable.
+ */
+void usage(char *executable_name) {
+	printf("Usage: %s -M <cols> -N <rows> [-s <s>] [-E <E>] [-b <b>]"
+			" [-j <threads>] [-k <top>] [-q] [-n] [-p]\n", executable_name);
+}
+
+
+
+/**
+ * Copies A[i][j] to B[j][i], simulating the load and the store.
+ */
+static void copyElement(run_t *run, const int *A, int *B, int i, int j) {
+	cacheAccess(run->cache, set_bits, block_bits, lines_per_set, 'L',
+			A_BASE + ((mem_addr)i * M + j) * 4, 4,
+			&run->hits, &run->misses, &run->evictions);
+	cacheAccess(run->cache, set_bits, block_bits, lines_per_set, 'S',
+			b_base + ((mem_addr)j * N + i) * 4, 4,
+			&run->hits, &run->misses, &run->evictions);
+	B[j * N + i] = A[i * M + j];
+}
+
+
+
+/**
+ * Transposes one tile of A into B in the order the variant asks for.
+ *
+ * @param v The variant being evaluated
+ * @param run Cache and counters of this evaluation
+ * @param A Source matrix, N rows of M
+ * @param B Destination matrix, M rows of N
+ * @param ii First row of the tile
+ * @param jj First column of the tile
+ */
+static void transposeTile(const variant_t *v, run_t *run, const int *A,
+		int *B, int ii, int jj) {
+	int i_end = ii + v->tile_rows < N ? ii + v->tile_rows : N;
+	int j_end = jj + v->tile_cols < M ? jj + v->tile_cols : M;
+	int i, j, diag;
+
+	if (!v->inner_by_col) {
+		for (i = ii; i < i_end; i++) {
+			diag = -1;
+			for (j = jj; j < j_end; j++) {
+				if (v->defer_diagonal && i == j) {
+					diag = j;
+				} else {
+					copyElement(run, A, B, i, j);
+				}
+			}
+			if (diag >= 0) {
+				copyElement(run, A, B, i, diag);
+			}
+		}
+	} else {
+		for (j = jj; j < j_end; j++) {
+			diag = -1;
+			for (i = ii; i < i_end; i++) {
+				if (v->defer_diagonal && i == j) {
+					diag = i;
+				} else {
+					copyElement(run, A, B, i, j);
+				}
+			}
+			if (diag >= 0) {
+				copyElement(run, A, B, diag, j);
+			}
+		}
+	}
+}
+
+
+
+/**
+ * Runs one variant on a cold cache and records its counts and correctness.
+ *
+ * @param v The variant to evaluate
+ * @param B Scratch destination matrix owned by the calling thread
+ */
+static void evaluate(variant_t *v, int *B) {
+	run_t run = { packed ? createPackedCache(1 << set_bits, lines_per_set)
+		: createCache(1 << set_bits, lines_per_set), 0, 0, 0 };
+	int ii, jj;
+
+	if (run.cache == NULL) {
+		printf("Error allocating cache\n");
+		exit(1);
+	}
+	memset(B, 0, (size_t)M * N * sizeof(int));
+	if (!v->tiles_by_col) {
+		for (ii = 0; ii < N; ii += v->tile_rows) {
+			for (jj = 0; jj < M; jj += v->tile_cols) {
+				transposeTile(v, &run, source, B, ii, jj);
+			}
+		}
+	} else {
+		for (jj = 0; jj < M; jj += v->tile_cols) {
+			for (ii = 0; ii < N; ii += v->tile_rows) {
+				transposeTile(v, &run, source, B, ii, jj);
+			}
+		}
+	}
+
+	v->result.correct = !memcmp(B, expected, (size_t)M * N * sizeof(int));
+	v->result.num_hits = run.hits;
+	v->result.num_misses = run.misses;
+	v->result.num_evictions = run.evictions;
+	freeCache(run.cache, 1 << set_bits);
+}
+
+
+
+/**
+ * Worker thread: evaluates variants until none are left.
+ */
+static void *worker(void *arg) {
+	int *B = malloc((size_t)M * N * sizeof(int));
+	int i;
+
+	(void)arg;
+	if (B == NULL) {
+		printf("Error allocating matrix\n");
+		exit(1);
+	}
+	for (;;) {
+		pthread_mutex_lock(&next_lock);
+		i = next_variant++;
+		pthread_mutex_unlock(&next_lock);
+		if (i >= num_variants) {
+			break;
+		}
+		evaluate(&variants[i], B);
+	}
+	free(B);
+	return NULL;
+}
+
+
+
+/**
+ * Orders variants by misses, then by generation order so ties are stable.
+ */
+static int compareVariants(const void *a, const void *b) {
+	const variant_t *va = a, *vb = b;
+	if (va->result.num_misses != vb->result.num_misses) {
+		return va->result.num_misses < vb->result.num_misses ? -1 : 1;
+	}
+	return va->index - vb->index;
+}
+
+
+
+/**
+ * Builds the list of variants to try.
+ */
+static void generateVariants(void) {
+	int r, c, order;
+
+	variants = malloc(NUM_TILE_SIZES * NUM_TILE_SIZES * 8
+			* sizeof(variant_t));
+	if (variants == NULL) {
+		printf("Error allocating variants\n");
+		exit(1);
+	}
+	num_variants = 0;
+	for (r = 0; r < NUM_TILE_SIZES; r++) {
+		if (tile_sizes[r] > N && r > 0 && tile_sizes[r - 1] >= N) {
+			continue;
+		}
+		for (c = 0; c < NUM_TILE_SIZES; c++) {
+			if (tile_sizes[c] > M && c > 0 && tile_sizes[c - 1] >= M) {
+				continue;
+			}
+			for (order = 0; order < 8; order++) {
+				variant_t *v = &variants[num_variants++];
+				memset(v, 0, sizeof(*v));
+				v->index = num_variants - 1;
+				v->tile_rows = tile_sizes[r];
+				v->tile_cols = tile_sizes[c];
+				v->tiles_by_col = order & 1;
+				v->inner_by_col = (order >> 1) & 1;
+				v->defer_diagonal = (order >> 2) & 1;
+				snprintf(v->description, sizeof(v->description),
+						"%dx%d tiles, tiles by %s, inner by %s%s",
+						v->tile_rows, v->tile_cols,
+						v->tiles_by_col ? "col" : "row",
+						v->inner_by_col ? "col" : "row",
+						v->defer_diagonal ? ", diagonal deferred" : "");
+			}
+		}
+	}
+}
+
+
+
+/**
+ * Main function of program. Evaluates every variant and reports the best.
+ *
+ * @param argc Number of arguments from the command line
+ * @param argv Arguments from the command line
+ */
+int main(int argc, char *argv[]) {
+	int threads = sysconf(_SC_NPROCESSORS_ONLN);
+	int top = 10, quiet = 0;
+	int c, i;
+
+	while ((c = getopt(argc, argv, "hM:N:s:E:b:j:k:qnp")) != -1) {
+		switch (c) {
+			case 'M':
+				M = strtol(optarg, NULL, 10);
+				break;
+			case 'N':
+				N = strtol(optarg, NULL, 10);
+				break;
+			case 's':
+				set_bits = strtol(optarg, NULL, 10);
+				break;
+			case 'E':
+				lines_per_set = strtol(optarg, NULL, 10);
+				break;
+			case 'b':
+				block_bits = strtol(optarg, NULL, 10);
+				break;
+			case 'j':
+				threads = strtol(optarg, NULL, 10);
+				break;
+			case 'k':
+				top = strtol(optarg, NULL, 10);
+				break;
+			case 'q':
+				// print only the winner, for use by scripts
+				quiet = 1;
+				break;
+			case 'n':
+				// keep each thread's caches on its own NUMA node
+				cacheSetAllocation(1, 1);
+				break;
+			case 'p':
+				// pack each cache so more fit in the host's caches
+				packed = 1;
+				break;
+			default:
+				usage(argv[0]);
+				exit(1);
+		}
+	}
+
+	if (M <= 0 || N <= 0 || lines_per_set <= 0) {
+		usage(argv[0]);
+		exit(1);
+	}
+	if (packed && lines_per_set > PACKED_MAX_WAYS) {
+		printf("Error: -p needs -E %d or less\n", PACKED_MAX_WAYS);
+		exit(1);
+	}
+	if (threads < 1) {
+		threads = 1;
+	}
+
+	size_t stride = MATRIX_STRIDE;
+	if ((size_t)M * N > stride) {
+		stride = ((size_t)M * N + MATRIX_STRIDE - 1) / MATRIX_STRIDE
+			* MATRIX_STRIDE;
+	}
+	b_base = A_BASE + stride * sizeof(int);
+
+	// initMatrix fills a B as well; it is only used as scratch here
+	source = malloc((size_t)M * N * sizeof(int));
+	expected = malloc((size_t)M * N * sizeof(int));
+	if (source == NULL || expected == NULL) {
+		printf("Error allocating matrices\n");
+		exit(1);
+	}
+	initMatrix(M, N, (int (*)[M])source, (int (*)[N])expected);
+	correctTrans(M, N, (int (*)[M])source, (int (*)[N])expected);
+
+	generateVariants();
+
+	pthread_t *tids = malloc(threads * sizeof(pthread_t));
+	for (i = 0; i < threads; i++) {
+		pthread_create(&tids[i], NULL, worker, NULL);
+	}
+	for (i = 0; i < threads; i++) {
+		pthread_join(tids[i], NULL);
+	}
+	free(tids);
+
+	// Incorrect variants can't win
+	int num_correct = 0;
+	for (i = 0; i < num_variants; i++) {
+		if (variants[i].result.correct) {
+			variants[num_correct++] = variants[i];
+		}
+	}
+	if (num_correct == 0) {
+		printf("Error: no correct variant\n");
+		exit(1);
+	}
+	qsort(variants, num_correct, sizeof(variant_t), compareVariants);
+	for (i = 0; i < num_correct; i++) {
+		variants[i].result.description = variants[i].description;
+	}
+
+	if (quiet) {
+		printf("%d %d %d %d %d %u\n", variants[0].tile_rows,
+				variants[0].tile_cols, variants[0].tiles_by_col,
+				variants[0].inner_by_col, variants[0].defer_diagonal,
+				variants[0].result.num_misses);
+	} else {
+		printf("%d variants of %dx%d transpose on (s=%d, E=%d, b=%d),"
+				" %d threads\n", num_variants, M, N, set_bits,
+				lines_per_set, block_bits, threads);
+		for (i = 0; i < top && i < num_correct; i++) {
+			printf("%3d. misses:%-8u hits:%-8u evictions:%-8u %s\n", i + 1,
+					variants[i].result.num_misses,
+					variants[i].result.num_hits,
+					variants[i].result.num_evictions,
+					variants[i].result.description);
+		}
+		printf("best: %s, misses:%u\n", variants[0].result.description,
+				variants[0].result.num_misses);
+	}
+
+	free(variants);
+	free(expected);
+	free(source);
+	return 0;
+}
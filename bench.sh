@@ -0,0 +1,74 @@
+#!/bin/sh
+#
+# bench.sh - Throughput benchmark for csim
+#
+# Generates synthetic traces with gentrace, runs csim over each of them for a
+# few representative (s,E,b) configurations and reports accesses/sec as the
+# mean and standard deviation over several runs. Every result is appended to
+# bench-results.csv together with the current commit, so runs can be
+# compared across commits.
+#
+# Environment overrides:
+#   BENCH_LENGTH     accesses per trace    (default 2000000)
+#   BENCH_FOOTPRINT  bytes touched         (default 8388608)
+#   BENCH_SEED       generator seed        (default 1)
+#   BENCH_REPS       runs per measurement  (default 5)
+#
+
+LENGTH=${BENCH_LENGTH:-2000000}
+FOOTPRINT=${BENCH_FOOTPRINT:-8388608}
+SEED=${BENCH_SEED:-1}
+REPS=${BENCH_REPS:-5}
+TRACE_DIR=bench-traces
+RESULTS=bench-results.csv
+
+PATTERNS="seq stride uniform zipf chase tile"
+
+# s E b: direct mapped, L1-like, L2-like, small fully associative
+CONFIGS="5:1:5 6:8:6 10:16:6 0:64:6"
+
+COMMIT=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+DATE=$(date -u +%Y-%m-%dT%H:%M:%SZ)
+
+mkdir -p $TRACE_DIR
+if [ ! -f $RESULTS ]; then
+	echo "date,commit,pattern,length,footprint,seed,s,E,b,reps,mean_aps,stddev_aps" > $RESULTS
+fi
+
+printf "%-8s %-9s %14s %12s\n" pattern "(s,E,b)" "accesses/sec" "stddev"
+
+for p in $PATTERNS; do
+	trace=$TRACE_DIR/$p-$FOOTPRINT-$LENGTH-$SEED.trace
+	if [ ! -f $trace ]; then
+		./gentrace -p $p -f $FOOTPRINT -n $LENGTH -r $SEED -o $trace || exit 1
+	fi
+
+	for config in $CONFIGS; do
+		s=${config%%:*}
+		rest=${config#*:}
+		E=${rest%%:*}
+		b=${rest#*:}
+
+		# One accesses/sec figure per run, from --stats-perf
+		samples=""
+		i=0
+		while [ $i -lt $REPS ]; do
+			aps=$(./csim -s $s -E $E -b $b -t $trace --stats-perf 2>&1 >/dev/null \
+				| awk '/accesses\/sec/ { print $2 }')
+			samples="$samples $aps"
+			i=$((i + 1))
+		done
+
+		echo $samples | awk -v p=$p -v cfg="($s,$E,$b)" \
+			-v csv="$DATE,$COMMIT,$p,$LENGTH,$FOOTPRINT,$SEED,$s,$E,$b,$REPS" \
+			-v results=$RESULTS '{
+			sum = 0; sq = 0
+			for (i = 1; i <= NF; i++) { sum += $i; sq += $i * $i }
+			mean = sum / NF
+			var = NF > 1 ? (sq - NF * mean * mean) / (NF - 1) : 0
+			sd = var > 0 ? sqrt(var) : 0
+			printf "%-8s %-9s %14.0f %12.0f\n", p, cfg, mean, sd
+			printf "%s,%.0f,%.0f\n", csv, mean, sd >> results
+		}'
+	done
+done
@@ -0,0 +1,891 @@
+/*
+ * cache.c
+ * Authors: Megan Bailey and Jake Wahl
+ *
+ * The cache model itself: one lookup-and-fill routine for L, S and M
+ * accesses, with table-driven accounting, and the LRU bookkeeping. Split
+ * out of csim.c so other drivers can feed accesses straight into it.
+ *
+ * Large line arenas are put on 2MB pages, so that the host's TLB covers
+ * them: explicit huge pages when the system has some reserved, else a
+ * 2MB-aligned mapping advised for transparent huge pages, else malloc.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+#include "cache.h"
+#include "fullassoc.h"
+#include "packed.h"
+#include "events.h"
+#include "perf.h"
+
+
+
+// Lines handed to the sets of a sparse cache are carved out of chunks of
+// at least this many
+#define SPARSE_CHUNK_LINES 65536
+
+// How arenas are allocated, from cacheSetAllocation
+static int use_huge_pages = 1;
+static int use_numa_local = 0;
+
+static const char *backing_names[] = {
+	[CACHE_BACKING_HEAP] = "heap",
+	[CACHE_BACKING_HUGETLB] = "2MB huge pages",
+	[CACHE_BACKING_THP] = "transparent huge pages",
+	[CACHE_BACKING_PAGES] = "4KB pages",
+	[CACHE_BACKING_FILE] = "mapped file"
+};
+
+// A block of lines for a sparse cache
+typedef struct line_chunk {
+	struct line_chunk *next;
+	size_t used, size;
+	Line lines[];
+} line_chunk_t;
+
+
+
+/**
+ * Allocates the Set array with its arena header in front of it. Every set
+ * starts out with no lines; calloc leaves a large array to the kernel's
+ * zero pages, so a sparse cache only pays for the part that is touched.
+ *
+ * @param num_sets Number of sets in the cache
+ * @return The Set array, or NULL when out of memory
+ */
+static Set *allocSets(int num_sets) {
+	char *block = calloc(1, sizeof(cache_arena_t) + num_sets * sizeof(Set));
+	if (block == NULL) {
+		return NULL;
+	}
+	return (Set *)(block + sizeof(cache_arena_t));
+}
+
+
+
+/**
+ * Chooses how later arenas are allocated.
+ *
+ * @param huge_pages Whether large arenas may use 2MB pages
+ * @param numa_local Whether arenas are bound to the NUMA node of the
+ *   thread creating them, rather than following the process policy
+ */
+void cacheSetAllocation(int huge_pages, int numa_local) {
+	use_huge_pages = huge_pages;
+	use_numa_local = numa_local;
+}
+
+
+
+/**
+ * Returns a description of a backing, for reports.
+ */
+const char *cacheBackingName(enum cache_backing backing) {
+	return backing_names[backing];
+}
+
+
+
+/**
+ * Maps size bytes of zeroed memory aligned to a huge page, advised to be
+ * backed by transparent huge pages.
+ *
+ * @return The mapping, or NULL
+ */
+static void *mapAligned(size_t size, enum cache_backing *backing) {
+	size_t padded = size + HUGE_PAGE_SIZE;
+	char *map = mmap(NULL, padded, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	char *base;
+
+	if (map == MAP_FAILED) {
+		return NULL;
+	}
+
+	// Trimming the ends so the mapping starts on a 2MB boundary
+	base = (char *)(((uintptr_t)map + HUGE_PAGE_SIZE - 1)
+			& ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+	if (base > map) {
+		munmap(map, base - map);
+	}
+	munmap(base + size, map + padded - (base + size));
+
+	*backing = CACHE_BACKING_PAGES;
+#ifdef MADV_HUGEPAGE
+	if (madvise(base, size, MADV_HUGEPAGE) == 0) {
+		*backing = CACHE_BACKING_THP;
+	}
+#endif
+	return base;
+}
+
+
+
+/**
+ * Allocates the lines of a dense cache into its arena, on huge pages when
+ * the arena is big enough to fill one.
+ *
+ * @param arena Receives the base, size and backing
+ * @param size Bytes needed
+ * @return 0 on success, -1 when out of memory
+ */
+static int allocArena(cache_arena_t *arena, size_t size) {
+	size_t rounded = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+	void *base = NULL;
+
+	arena->mapped = 1;
+	if (use_huge_pages && size >= HUGE_PAGE_SIZE) {
+#ifdef MAP_HUGETLB
+		base = mmap(NULL, rounded, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		arena->backing = CACHE_BACKING_HUGETLB;
+		if (base == MAP_FAILED) {
+			base = NULL;
+		}
+#endif
+		if (base == NULL) {
+			base = mapAligned(rounded, &arena->backing);
+		}
+	}
+
+	// Small arenas, and the last resort
+	if (base == NULL) {
+		base = malloc(size);
+		if (base == NULL) {
+			return -1;
+		}
+		arena->mapped = 0;
+		arena->backing = CACHE_BACKING_HEAP;
+		rounded = size;
+	}
+	arena->base = base;
+	arena->size = rounded;
+
+	// Pages are placed when first touched, by whichever thread touches
+	// them; binding the mapping keeps them on this thread's node
+	arena->numa_local = 0;
+#if defined(__linux__) && defined(SYS_mbind)
+	if (use_numa_local && arena->mapped) {
+		arena->numa_local = syscall(SYS_mbind, base, rounded, MPOL_LOCAL,
+				NULL, 0, 0) == 0;
+	}
+#endif
+	return 0;
+}
+
+
+
+/**
+ * Empties lines, ranking them for LRU in line order.
+ *
+ * @param lines The lines of one set
+ * @param lines_per_set Number of lines in the set
+ */
+void cacheInitLines(Line *lines, int lines_per_set) {
+	int j;
+	for (j = 0; j < lines_per_set; j++){
+		lines[j].valid = 0;
+		lines[j].lru = j;
+		lines[j].tag = 0;
+	}
+}
+
+
+
+/**
+ * Points every set at its lines inside one contiguous block.
+ *
+ * @param cache The Set array
+ * @param lines The block of num_sets * lines_per_set lines
+ * @param num_sets Number of sets in the cache
+ * @param lines_per_set Number of lines in each cache set
+ */
+static void linkSets(Set *cache, Line *lines, int num_sets,
+		int lines_per_set) {
+	int i;
+	for (i = 0; i < num_sets; i++){
+		cache[i].Lines = lines + (size_t)i * lines_per_set;
+	}
+}
+
+
+
+/**
+ * Allocates a cache with every line invalid. All lines live in one
+ * contiguous block so the state can be saved and mapped back as a whole.
+ *
+ * @param num_sets Number of sets in the cache
+ * @param lines_per_set Number of lines in each cache set
+ * @return The new cache, to be released with freeCache, or NULL when out
+ *   of memory
+ */
+Set *createCache(int num_sets, int lines_per_set) {
+	Set *cache = allocSets(num_sets);
+	size_t num_lines = (size_t)num_sets * lines_per_set;
+
+	if (cache == NULL) {
+		return NULL;
+	}
+	cache_arena_t *arena = cacheArena(cache);
+	if (allocArena(arena, num_lines * sizeof(Line))) {
+		free(arena);
+		return NULL;
+	}
+	Line *lines = arena->base;
+	linkSets(cache, lines, num_sets, lines_per_set);
+
+	// Iniitializes Cache inards
+	int i;
+	for (i = 0; i < num_sets; i++){
+		cacheInitLines(cache[i].Lines, lines_per_set);
+	}
+	return cache;
+}
+
+
+
+/**
+ * Allocates a cache whose sets get their lines on first touch, so memory
+ * and start-up time follow the sets a trace uses rather than the size of
+ * the cache. The lines of different sets aren't contiguous.
+ *
+ * @param num_sets Number of sets in the cache
+ * @param lines_per_set Number of lines in each cache set
+ * @return The new cache, to be released with freeCache, or NULL when out
+ *   of memory
+ */
+Set *createSparseCache(int num_sets, int lines_per_set) {
+	Set *cache = allocSets(num_sets);
+
+	(void)lines_per_set;
+	if (cache != NULL) {
+		cacheArena(cache)->sparse = 1;
+	}
+	return cache;
+}
+
+
+
+/**
+ * Allocates a cache kept in the packed encoding of packed.c rather than in
+ * lines, for sweeps that run many caches side by side. The results are
+ * the same, but there are no Line arrays: only cacheAccessBatch and the
+ * calls built on it may be used, not cacheLookup, cacheVictim, cacheFill,
+ * cacheInvalidate, updateLRU or checkpoints.
+ *
+ * @param num_sets Number of sets in the cache
+ * @param lines_per_set Number of lines per set, at most PACKED_MAX_WAYS
+ * @return The new cache, to be released with freeCache, or NULL when out
+ *   of memory
+ */
+Set *createPackedCache(int num_sets, int lines_per_set) {
+	Set *cache = allocSets(0);
+
+	if (cache == NULL) {
+		return NULL;
+	}
+	cache_arena_t *arena = cacheArena(cache);
+	arena->packed = packedCreate(num_sets, lines_per_set);
+	if (arena->packed == NULL) {
+		free(arena);
+		return NULL;
+	}
+	arena->size = packedBytes(arena->packed);
+	return cache;
+}
+
+
+
+/**
+ * Returns the lines of a set, giving it empty ones if this is the first
+ * time a sparse cache's set is touched.
+ *
+ * @param cache An array of type Set that simulates a cache
+ * @param set The set
+ * @param lines_per_set Number of lines in each cache set
+ * @return The set's lines, or NULL when out of memory
+ */
+Line *cacheTouchSet(Set *cache, int set, int lines_per_set) {
+	cache_arena_t *arena = cacheArena(cache);
+	line_chunk_t *chunk = arena->chunks;
+
+	if (cache[set].Lines != NULL) {
+		return cache[set].Lines;
+	}
+	if (chunk == NULL || chunk->used + lines_per_set > chunk->size) {
+		size_t size = lines_per_set > SPARSE_CHUNK_LINES ? lines_per_set
+			: SPARSE_CHUNK_LINES / lines_per_set * lines_per_set;
+		chunk = malloc(sizeof(line_chunk_t) + size * sizeof(Line));
+		if (chunk == NULL) {
+			return NULL;
+		}
+		chunk->next = arena->chunks;
+		chunk->used = 0;
+		chunk->size = size;
+		arena->chunks = chunk;
+	}
+	cache[set].Lines = chunk->lines + chunk->used;
+	chunk->used += lines_per_set;
+	arena->size += lines_per_set * sizeof(Line);
+	cacheInitLines(cache[set].Lines, lines_per_set);
+	return cache[set].Lines;
+}
+
+
+
+/**
+ * Wraps lines that live in an mmapped region, such as a checkpoint file,
+ * as a cache. freeCache unmaps the region.
+ *
+ * @param lines The first line of the cache inside the mapping
+ * @param num_sets Number of sets in the cache
+ * @param lines_per_set Number of lines in each cache set
+ * @param base Start of the mapping
+ * @param size Length of the mapping
+ * @return The cache, to be released with freeCache, or NULL when out of
+ *   memory, leaving the mapping to the caller
+ */
+Set *createMappedCache(Line *lines, int num_sets, int lines_per_set,
+		void *base, size_t size) {
+	Set *cache = allocSets(num_sets);
+
+	if (cache == NULL) {
+		return NULL;
+	}
+	cache_arena_t *arena = cacheArena(cache);
+	arena->base = base;
+	arena->size = size;
+	arena->mapped = 1;
+	arena->backing = CACHE_BACKING_FILE;
+	linkSets(cache, lines, num_sets, lines_per_set);
+	return cache;
+}
+
+
+
+/**
+ * Returns the header describing where a cache's lines are stored.
+ *
+ * @param cache A cache from createCache or createMappedCache
+ */
+cache_arena_t *cacheArena(Set *cache) {
+	return (cache_arena_t *)((char *)cache - sizeof(cache_arena_t));
+}
+
+
+
+/**
+ * Gives a cache with one set the fully associative engine, which finds a
+ * tag and keeps LRU order in O(1) where the scan would take O(lines). The
+ * lines keep their valid bits and tags, but their lru fields are only
+ * brought up to date by cacheSync. cacheFill, cacheInvalidate and
+ * updateLRU must not be used on it.
+ *
+ * @param cache A cache with a single set
+ * @param lines_per_set Number of lines in the set
+ * @return 0 on success, -1 when out of memory, leaving the cache as it was
+ */
+int cacheIndex(Set *cache, int lines_per_set) {
+	cacheArena(cache)->index = faCreate(cache[0].Lines, lines_per_set);
+	return cacheArena(cache)->index != NULL ? 0 : -1;
+}
+
+
+
+/**
+ * Writes the LRU order of a cache with the fully associative engine back
+ * into its lines. Does nothing for other caches.
+ *
+ * @param cache The cache
+ */
+void cacheSync(Set *cache) {
+	if (cacheArena(cache)->index != NULL) {
+		faSync(cacheArena(cache)->index);
+	}
+}
+
+
+
+/**
+ * Releases a cache allocated by createCache or createMappedCache.
+ *
+ * @param cache The cache to free
+ * @param num_sets Number of sets in the cache
+ */
+void freeCache(Set *cache, int num_sets) {
+	cache_arena_t *arena = cacheArena(cache);
+
+	(void)num_sets;
+	if (arena->index != NULL) {
+		faFree(arena->index);
+	}
+	if (arena->packed != NULL) {
+		packedFree(arena->packed);
+	}
+	while (arena->chunks != NULL) {
+		line_chunk_t *next = arena->chunks->next;
+		free(arena->chunks);
+		arena->chunks = next;
+	}
+	if (arena->mapped) {
+		munmap(arena->base, arena->size);
+	} else {
+		free(arena->base);
+	}
+	free(arena);
+}
+
+
+
+// Counter increments and event flags for one outcome
+typedef struct access_counts {
+	unsigned char hits, misses, evictions, events;
+} access_counts_t;
+
+// Accounting for each outcome, for L or S and for M, which is a load
+// followed by a store that always hits
+static const access_counts_t access_table[ACCESS_NUM_OUTCOMES][2] = {
+	[ACCESS_NONE] = { { 0, 0, 0, 0 }, { 0, 0, 0, 0 } },
+	[ACCESS_HIT] = { { 1, 0, 0, EVENT_HIT }, { 2, 0, 0, EVENT_HIT } },
+	[ACCESS_MISS] = { { 0, 1, 0, EVENT_MISS }, { 1, 1, 0, EVENT_MISS } },
+	[ACCESS_EVICTION] = { { 0, 1, 1, EVENT_MISS | EVENT_EVICTION },
+		{ 1, 1, 1, EVENT_MISS | EVENT_EVICTION } }
+};
+
+
+
+/**
+ * cacheAccessBatch for a cache with the fully associative engine or the
+ * packed encoding.
+ */
+static void accessEngine(cache_arena_t *arena, int set_bits, int block_bits,
+		const trace_record_t *records, size_t count, int verbose,
+		unsigned char *outcomes, int *hit_count, int *miss_count,
+		int *eviction_count) {
+	mem_addr set_mask = (1UL << set_bits) - 1;
+	size_t r;
+
+	for (r = 0; r < count; r++) {
+		const trace_record_t *rec = &records[r];
+		enum access_outcome outcome = ACCESS_NONE;
+
+		if (rec->operation == 'L' || rec->operation == 'S'
+				|| rec->operation == 'M') {
+			if (arena->index != NULL) {
+				outcome = faAccess(arena->index, rec->address >> block_bits);
+			} else {
+				outcome = packedAccess(arena->packed,
+						(size_t)((rec->address >> block_bits) & set_mask),
+						rec->address >> (block_bits + set_bits));
+			}
+			PERF_MARK(PERF_LOOKUP);
+
+			const access_counts_t *counts =
+				&access_table[outcome][rec->operation == 'M'];
+			*hit_count += counts->hits;
+			*miss_count += counts->misses;
+			*eviction_count += counts->evictions;
+
+			if (verbose) {
+				eventRecord(rec->operation, rec->address, rec->size,
+						counts->events);
+				PERF_MARK(PERF_OUTPUT);
+			}
+		}
+		if (outcomes != NULL) {
+			outcomes[r] = outcome;
+		}
+	}
+
+	// Wide sets may have grown the packed state
+	if (arena->packed != NULL) {
+		arena->size = packedBytes(arena->packed);
+	}
+}
+
+
+
+/**
+ * Simulates a buffer of decoded records in order. Each L, S or M record
+ * is looked up, and on a miss filled into the first empty line or the
+ * least recently used one, all in a single loop.
+ *
+ * @param cache An array of type Set that simulates a cache
+ * @param set_bits Number of set index bits
+ * @param block_bits Number of block offset bits
+ * @param lines_per_set Number of lines per cache set
+ * @param records The records; other operations than L, S and M are ignored
+ * @param count Number of records
+ * @param verbose A flag which is set when events are recorded
+ * @param outcomes Receives the access_outcome of each record, may be NULL
+ * @param hit_count A counter of cache hits
+ * @param miss_count A counter of cache misses
+ * @param eviction_count A counter of cache evictions
+ * @return Number of records simulated, fewer than count only when a sparse
+ *   cache runs out of memory for the lines of a set
+ */
+size_t cacheAccessBatch(Set *cache, int set_bits, int block_bits,
+		int lines_per_set, const trace_record_t *records, size_t count,
+		int verbose, unsigned char *outcomes, int *hit_count,
+		int *miss_count, int *eviction_count) {
+	mem_addr set_mask = (1UL << set_bits) - 1;
+	unsigned int last = lines_per_set - 1;
+	int hits = *hit_count, misses = *miss_count;
+	int evictions = *eviction_count;
+	size_t r;
+
+	if (cacheArena(cache)->index != NULL
+			|| cacheArena(cache)->packed != NULL) {
+		accessEngine(cacheArena(cache), set_bits, block_bits, records,
+				count, verbose, outcomes, hit_count, miss_count,
+				eviction_count);
+		return count;
+	}
+
+	for (r = 0; r < count; r++) {
+		const trace_record_t *rec = &records[r];
+		enum access_outcome outcome = ACCESS_NONE;
+
+		if (rec->operation == 'L' || rec->operation == 'S'
+				|| rec->operation == 'M') {
+			int set = (int)((rec->address >> block_bits) & set_mask);
+			mem_addr tag = rec->address >> (block_bits + set_bits);
+			Line *lines = cache[set].Lines;
+			int i, way = -1, empty = -1, victim = -1;
+
+			// Only the sets of a sparse cache are ever missing
+			if (lines == NULL) {
+				lines = cacheTouchSet(cache, set, lines_per_set);
+				if (lines == NULL) {
+					break;
+				}
+			}
+
+			// One pass finds the hit, or else the first empty line and the
+			// least recently used one
+			for (i = 0; i < lines_per_set; i++) {
+				if (lines[i].valid) {
+					if (lines[i].tag == tag) {
+						way = i;
+						break;
+					}
+				} else if (empty < 0) {
+					empty = i;
+				}
+				if (lines[i].lru == last) {
+					victim = i;
+				}
+			}
+
+			if (way >= 0) {
+				outcome = ACCESS_HIT;
+			} else {
+				outcome = empty >= 0 ? ACCESS_MISS : ACCESS_EVICTION;
+				way = empty >= 0 ? empty : victim;
+				lines[way].valid = 1;
+				lines[way].tag = tag;
+			}
+			PERF_MARK(PERF_LOOKUP);
+
+			// Updating set LRU, as updateLRU does: the valid lines used
+			// since this one age by one, and it becomes the newest
+			unsigned int prev_lru = lines[way].lru;
+			for (i = 0; i < lines_per_set; i++) {
+				lines[i].lru += lines[i].valid && lines[i].lru < prev_lru;
+			}
+			lines[way].lru = 0;
+			PERF_MARK(PERF_REPLACEMENT);
+
+			const access_counts_t *counts =
+				&access_table[outcome][rec->operation == 'M'];
+			hits += counts->hits;
+			misses += counts->misses;
+			evictions += counts->evictions;
+
+			// Printing for verbose mode
+			if (verbose) {
+				eventRecord(rec->operation, rec->address, rec->size,
+						counts->events);
+				PERF_MARK(PERF_OUTPUT);
+			}
+		}
+		if (outcomes != NULL) {
+			outcomes[r] = outcome;
+		}
+	}
+
+	*hit_count = hits;
+	*miss_count = misses;
+	*eviction_count = evictions;
+	return r;
+}
+
+
+
+/**
+ * Decodes an address and simulates one access. For the drivers, running
+ * out of memory for a sparse cache's lines ends the program as their other
+ * allocation failures do; cacheAccessBatch reports it instead.
+ *
+ * @param cache An array of type Set that simulates a cache
+ * @param set_bits Number of set index bits
+ * @param block_bits Number of block offset bits
+ * @param lines_per_set Number of lines per cache set
+ * @param operation 'L', 'S' or 'M'; anything else does nothing
+ * @param address Memory location of the access
+ * @param size Number of bytes accessed
+ * @param verbose A flag which is set when events are recorded
+ * @param hit_count A counter of cache hits
+ * @param miss_count A counter of cache misses
+ * @param eviction_count A counter of cache evictions
+ * @return What the access did
+ */
+enum access_outcome cacheOperation(Set *cache, int set_bits, int block_bits,
+		int lines_per_set, char operation, mem_addr address, int size,
+		int verbose, int *hit_count, int *miss_count, int *eviction_count) {
+	trace_record_t record = { address, size, operation };
+	unsigned char outcome;
+
+	if (cacheAccessBatch(cache, set_bits, block_bits, lines_per_set, &record,
+				1, verbose, &outcome, hit_count, miss_count,
+				eviction_count) == 0) {
+		printf("Error allocating cache\n");
+		exit(1);
+	}
+	return outcome;
+}
+
+
+
+/**
+ * Decodes an address and applies one L, S or M access to the cache, for
+ * drivers that produce accesses rather than trace lines.
+ *
+ * @param cache An array of type Set that simulates a cache
+ * @param set_bits Number of set index bits
+ * @param block_bits Number of block offset bits
+ * @param lines_per_set Number of lines per cache set
+ * @param operation 'L', 'S' or 'M'
+ * @param address Memory location of the access
+ * @param size Number of bytes accessed
+ * @param hit_count A counter of cache hits
+ * @param miss_count A counter of cache misses
+ * @param eviction_count A counter of cache evictions
+ */
+void cacheAccess(Set *cache, int set_bits, int block_bits, int lines_per_set,
+		char operation, mem_addr address, int size, int *hit_count,
+		int *miss_count, int *eviction_count) {
+	cacheOperation(cache, set_bits, block_bits, lines_per_set, operation,
+			address, size, 0, hit_count, miss_count, eviction_count);
+}
+
+
+
+/**
+ * Applies an L, S or M access to every block its bytes cover, as one
+ * access per block. Each piece is shown separately in verbose mode.
+ *
+ * @param cache An array of type Set that simulates a cache
+ * @param set_bits Number of set index bits
+ * @param block_bits Number of block offset bits
+ * @param lines_per_set Number of lines per cache set
+ * @param operation 'L', 'S' or 'M'
+ * @param address Memory location of the access
+ * @param size Number of bytes accessed, at least 1
+ * @param verbose A flag which is set when events are recorded
+ * @param hit_count A counter of cache hits
+ * @param miss_count A counter of cache misses
+ * @param eviction_count A counter of cache evictions
+ * @return Number of blocks the access covered
+ */
+int cacheAccessSplit(Set *cache, int set_bits, int block_bits,
+		int lines_per_set, char operation, mem_addr address, int size,
+		int verbose, int *hit_count, int *miss_count, int *eviction_count) {
+	mem_addr block_mask = (1UL << block_bits) - 1;
+	int blocks = (int)(((address & block_mask) + size - 1) >> block_bits) + 1;
+
+	// Almost every access stays inside one block
+	if (blocks == 1) {
+		cacheOperation(cache, set_bits, block_bits, lines_per_set, operation,
+				address, size, verbose, hit_count, miss_count,
+				eviction_count);
+		return 1;
+	}
+
+	// Counted in blocks rather than up to an end address, which wraps for
+	// an access at the top of memory
+	int b, left = size;
+	for (b = 0; b < blocks; b++) {
+		mem_addr next = (address | block_mask) + 1;
+		int piece = next - address < (mem_addr)left
+			? (int)(next - address) : left;
+		cacheOperation(cache, set_bits, block_bits, lines_per_set, operation,
+				address, piece, verbose, hit_count, miss_count,
+				eviction_count);
+		left -= piece;
+		address = next;
+	}
+	return blocks;
+}
+
+
+
+/**
+ * Finds the line holding a tag without touching any state.
+ *
+ * @param cache An array of type Set that simulates a cache
+ * @param lines_per_set Number of lines per cache set
+ * @param set The set to search
+ * @param tag The tag to look for
+ * @return The line number in the set, or -1 if the tag isn't cached
+ */
+int cacheLookup(Set *cache, int lines_per_set, int set, mem_addr tag) {
+	Line *lines = cache[set].Lines;
+	int i;
+
+	if (cacheArena(cache)->index != NULL) {
+		return faLookup(cacheArena(cache)->index, tag);
+	}
+	if (lines == NULL) {
+		return -1;
+	}
+	for (i = 0; i < lines_per_set; i++) {
+		if (lines[i].valid && lines[i].tag == tag) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+
+
+/**
+ * Picks the line a miss in a set would fill: the first empty line, or the
+ * least recently used one. An untouched set of a sparse cache is given its
+ * lines first.
+ *
+ * @param cache An array of type Set that simulates a cache
+ * @param lines_per_set Number of lines per cache set
+ * @param set The set that missed
+ * @return The line number in the set, or -1 if a sparse cache is out of
+ *   memory for the set's lines
+ */
+int cacheVictim(Set *cache, int lines_per_set, int set) {
+	Line *lines = cache[set].Lines;
+	int i, victim = 0;
+
+	if (cacheArena(cache)->index != NULL) {
+		return faVictim(cacheArena(cache)->index);
+	}
+	if (lines == NULL) {
+		lines = cacheTouchSet(cache, set, lines_per_set);
+		if (lines == NULL) {
+			return -1;
+		}
+	}
+	for (i = 0; i < lines_per_set; i++) {
+		if (!lines[i].valid) {
+			return i;
+		}
+		if (lines[i].lru == (unsigned int)lines_per_set - 1) {
+			victim = i;
+		}
+	}
+	return victim;
+}
+
+
+
+/**
+ * Puts a tag into a line and makes it the most recently used.
+ *
+ * @param cache An array of type Set that simulates a cache
+ * @param lines_per_set Number of lines per cache set
+ * @param set The set of the line
+ * @param way The line number in the set, from cacheVictim
+ * @param tag The new tag
+ */
+void cacheFill(Set *cache, int lines_per_set, int set, int way,
+		mem_addr tag) {
+	Line *line = &cache[set].Lines[way];
+
+	line->valid = 1;
+	line->tag = tag;
+	updateLRU(cache, set, line->lru, lines_per_set);
+}
+
+
+
+/**
+ * Invalidates one line, such as when another cache takes the block. The
+ * tag is left in place. LRU positions are renumbered so the valid lines
+ * keep the most recent ones and empty lines are still filled in order.
+ *
+ * @param cache An array of type Set that simulates a cache
+ * @param lines_per_set Number of lines per cache set
+ * @param set The set of the line
+ * @param way The line number in the set
+ */
+void cacheInvalidate(Set *cache, int lines_per_set, int set, int way) {
+	Line *lines = cache[set].Lines;
+	unsigned int lru = lines[way].lru, rank = 0;
+	int i;
+
+	lines[way].valid = 0;
+	for (i = 0; i < lines_per_set; i++) {
+		if (lines[i].valid) {
+			if (lines[i].lru > lru) {
+				lines[i].lru--;
+			}
+			rank++;
+		}
+	}
+	for (i = 0; i < lines_per_set; i++) {
+		if (!lines[i].valid) {
+			lines[i].lru = rank++;
+		}
+	}
+}
+
+
+
+/**
+ * Updates Least Recently Used bit in a set after a memory access.
+ *
+ *
+ * @param cache An array of type Set that simulates a cache
+ * @param set_num The set number in the cache that needs to be updated
+ * @param prev_lru The previous LRU at line that was recently accessed
+ * @param lines_per_set Number of lines per cache set
+ */
+void updateLRU(Set *cache, int set_num,int prev_lru, int lines_per_set) { 
+	int i;
+
+	// Update valid lines LRU
+	for (i = 0; i < lines_per_set; i++) {
+		if (cache[set_num].Lines[i].valid == 1) {
+
+			// Only updating LRU lower than modified lines LRU
+			if (cache[set_num].Lines[i].lru <= prev_lru) {
+				if(cache[set_num].Lines[i].lru == prev_lru) {
+
+					// Setting modified lines LRU to 0 
+					cache[set_num].Lines[i].lru = 0;
+				} else {
+
+					// Incrementing nonmodified lines
+					cache[set_num].Lines[i].lru++;
+				}
+			}
+		}
+	}
+}
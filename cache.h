@@ -0,0 +1,107 @@
+/*
+ * cache.h - The cache model shared by csim and the other drivers
+ */
+
+#ifndef CSIM_CACHE_H
+#define CSIM_CACHE_H
+
+#include <stddef.h>
+
+//Type def's to sooth carpal tunnel
+typedef unsigned long int mem_addr;
+typedef struct Line Line;
+typedef struct Set Set;
+
+//Struct to hold individual line of cache. The tag is every address bit
+//above the set bits, so no two blocks share one.
+struct Line {
+	unsigned int valid;
+	unsigned int lru;
+	mem_addr tag;
+};
+
+//Struct to hold a set of lines
+struct Set {
+	Line *Lines;
+};
+
+//One decoded access
+typedef struct trace_record {
+	mem_addr address;
+	int size;
+	char operation;
+	unsigned short thread;  /* core of a merged multicore trace */
+} trace_record_t;
+
+//What an access did; an M that misses still hits on its store
+enum access_outcome {
+	ACCESS_NONE,      /* not an L, S or M */
+	ACCESS_HIT,
+	ACCESS_MISS,
+	ACCESS_EVICTION,  /* a miss that evicted a line */
+	ACCESS_NUM_OUTCOMES
+};
+
+//What the lines of a cache ended up stored in
+enum cache_backing {
+	CACHE_BACKING_HEAP,      /* malloc */
+	CACHE_BACKING_HUGETLB,   /* explicit 2MB pages from MAP_HUGETLB */
+	CACHE_BACKING_THP,       /* 2MB-aligned mapping advised MADV_HUGEPAGE */
+	CACHE_BACKING_PAGES,     /* ordinary anonymous mapping */
+	CACHE_BACKING_FILE       /* a mapped checkpoint */
+};
+
+//Where the lines of a cache are stored, kept just in front of its Set array
+typedef struct cache_arena {
+	void *base;
+	size_t size;
+	int mapped;
+	enum cache_backing backing;
+	int numa_local;          /* bound to the allocating thread's node */
+	struct fa_index *index;  /* O(1) engine of a one-set cache, or NULL */
+	int sparse;              /* sets get lines when first touched */
+	struct line_chunk *chunks;  /* where a sparse cache's lines come from */
+	struct packed_cache *packed;  /* compact state instead of lines */
+} cache_arena_t;
+
+//Caches with at least this many set bits are made sparse by csim
+#define SPARSE_SET_BITS 20
+
+//Arenas at least this big are backed by huge pages where possible
+#define HUGE_PAGE_SIZE (2UL << 20)
+
+// forward declaration
+Set *createCache(int num_sets, int lines_per_set);
+Set *createMappedCache(Line *lines, int num_sets, int lines_per_set,
+		void *base, size_t size);
+Set *createSparseCache(int num_sets, int lines_per_set);
+Set *createPackedCache(int num_sets, int lines_per_set);
+Line *cacheTouchSet(Set *cache, int set, int lines_per_set);
+void cacheInitLines(Line *lines, int lines_per_set);
+void cacheSetAllocation(int huge_pages, int numa_local);
+const char *cacheBackingName(enum cache_backing backing);
+cache_arena_t *cacheArena(Set *cache);
+int cacheIndex(Set *cache, int lines_per_set);
+void cacheSync(Set *cache);
+void freeCache(Set *cache, int num_sets);
+void cacheAccess(Set *cache, int set_bits, int block_bits, int lines_per_set,
+		char operation, mem_addr address, int size, int *hit_count,
+		int *miss_count, int *eviction_count);
+enum access_outcome cacheOperation(Set *cache, int set_bits, int block_bits,
+		int lines_per_set, char operation, mem_addr address, int size,
+		int verbose, int *hit_count, int *miss_count, int *eviction_count);
+size_t cacheAccessBatch(Set *cache, int set_bits, int block_bits,
+		int lines_per_set, const trace_record_t *records, size_t count,
+		int verbose, unsigned char *outcomes, int *hit_count,
+		int *miss_count, int *eviction_count);
+int cacheAccessSplit(Set *cache, int set_bits, int block_bits,
+		int lines_per_set, char operation, mem_addr address, int size,
+		int verbose, int *hit_count, int *miss_count, int *eviction_count);
+int cacheLookup(Set *cache, int lines_per_set, int set, mem_addr tag);
+int cacheVictim(Set *cache, int lines_per_set, int set);
+void cacheFill(Set *cache, int lines_per_set, int set, int way,
+		mem_addr tag);
+void cacheInvalidate(Set *cache, int lines_per_set, int set, int way);
+void updateLRU(Set *cache, int set_num, int prev_lru, int lines_per_set);
+
+#endif /* CSIM_CACHE_H */
@@ -16,6 +16,10 @@ typedef struct trans_func{
   unsigned int num_evictions;
 } trans_func_t;
 
+/* Functions added by registerTransFunction, defined in cachelab.c */
+extern trans_func_t func_list[MAX_TRANS_FUNCS];
+extern int func_counter;
+
 /* 
  * printSummary - This function provides a standard way for your cache
  * simulator * to display its final hit and miss statistics
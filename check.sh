@@ -0,0 +1,262 @@
+#!/bin/sh
+#
+# check.sh - Consistency checks for csim
+#
+# Every result csim can reach by more than one route is computed both ways
+# over the traces in traces/ and compared. Each check prints one line per
+# mismatch; the script exits non-zero if there were any.
+#
+
+TRACES="traces/yi.trace traces/yi2.trace traces/dave.trace traces/trans.trace
+	traces/long.trace"
+
+failures=0
+
+# fail <what>: report one mismatch
+fail() {
+	echo "FAIL: $*"
+	failures=$((failures + 1))
+}
+
+# counts <csim args>: the summary line of a plain csim run
+counts() {
+	./csim "$@" | tail -n 1
+}
+
+# spread <bit> <trace>: the trace with a zero bit spliced into every
+# address at bit, moving the bits above it up one
+spread() {
+	awk -v bit=$1 '
+	function hex(n,    s) {
+		s = ""
+		do {
+			s = substr("0123456789abcdef", n % 16 + 1, 1) s
+			n = int(n / 16)
+		} while (n > 0)
+		return s
+	}
+	{
+		comma = index($0, ",")
+		if (comma == 0) {
+			print
+			next
+		}
+		head = substr($0, 1, comma - 1)
+		n = split(head, field, " ")
+		address = 0
+		for (i = 1; i <= length(field[n]); i++) {
+			address = address * 16 + index("0123456789abcdef",
+				tolower(substr(field[n], i, 1))) - 1
+		}
+		low = address % 2 ^ bit
+		address = (address - low) * 2 + low
+		print substr(head, 1, length(head) - length(field[n])) \
+			hex(address) substr($0, comma)
+	}' $2
+}
+
+#
+# Fully associative caches: -s 0 runs the O(1) engine of fullassoc.c. With
+# a zero bit spliced in above the block offset, every block of the trace
+# lands in set 0 of a two set cache under the same tag, which the line
+# scan simulates. Covers direct mapped, odd sizes, eviction-heavy small
+# caches and ones larger than any trace's working set.
+#
+spread_trace=$(mktemp)
+for t in $TRACES; do
+	for config in "1 0" "2 4" "3 1" "7 2" "16 0" "64 5" "512 2" "1024 3"; do
+		set -- $config
+		spread $2 $t > $spread_trace
+		want=$(counts -s 1 -E $1 -b $2 -t $spread_trace)
+		got=$(counts -s 0 -E $1 -b $2 -t $t)
+		[ "$want" = "$got" ] || fail "-s 0 -E $1 -b $2 -t $t: $got," \
+			"line scan $want"
+	done
+done
+rm -f $spread_trace
+
+#
+# Packed state: --packed counts what the Line arrays do, up to the most
+# lines per set it holds. Page walks put tags far apart in one set, which
+# widens sets out of the 16 bit deltas.
+#
+for t in $TRACES traces/pagewalk.trace; do
+	for config in "0 1 0" "0 16 4" "1 3 0" "2 16 0" "4 16 2" "6 5 3" \
+			"10 1 4" "8 16 6"; do
+		set -- $config
+		want=$(counts -s $1 -E $2 -b $3 -t $t)
+		got=$(counts -s $1 -E $2 -b $3 -t $t --packed)
+		[ "$want" = "$got" ] || fail "--packed -s $1 -E $2 -b $3 -t $t:" \
+			"$got, plain $want"
+	done
+	for config in "0 16 2" "2 8 4" "1 4 1"; do
+		set -- $config
+		want=$(counts -s $1 -E $2 -b $3 -t $t --tlb 4:4 --page-walk)
+		got=$(counts -s $1 -E $2 -b $3 -t $t --tlb 4:4 --page-walk --packed)
+		[ "$want" = "$got" ] || fail "--packed --page-walk -s $1 -E $2" \
+			"-b $3 -t $t: $got, plain $want"
+	done
+done
+
+#
+# Sweeps: every lane of --sweep counts what a run of its cache alone does.
+# Twelve caches make two groups, the second only partly full.
+#
+num='\([0-9]*\)'
+sweep="0:1:0,0:4:0,0:2:3,1:3:0,2:4:1,10:1:4,3:1:2,5:4:5,1:4:0,8:2:6,0:3:1"
+for t in $TRACES; do
+	out=$(./csim -s 4 -E 4 -b 2 -t $t --sweep $sweep)
+	want=$(counts -s 4 -E 4 -b 2 -t $t)
+	got=$(echo "$out" | tail -n 1)
+	[ "$want" = "$got" ] || fail "--sweep $sweep -t $t: first cache $got," \
+		"plain $want"
+	lanes=$(echo "$out" | grep -c "^Sweep ")
+	[ "$lanes" = 11 ] || fail "--sweep $sweep -t $t: $lanes lanes printed"
+	while read s E b got; do
+		want=$(counts -s $s -E $E -b $b -t $t)
+		[ "$want" = "$got" ] || fail "--sweep lane -s $s -E $E -b $b -t $t:" \
+			"$got, plain $want"
+	done <<-EOF
+	$(echo "$out" | sed -n "s/^Sweep s:$num E:$num b:$num /\\1 \\2 \\3 /p")
+	EOF
+done
+
+#
+# libcsim: replaying a trace through csimAccessN counts what csim does, and
+# the shared library exports nothing but the csim* API
+#
+for t in $TRACES; do
+	for config in "0 1 0" "1 1 1" "4 2 4" "5 1 5" "0 8 4" "2 4 3" "21 1 4"; do
+		set -- $config
+		want=$(counts -s $1 -E $2 -b $3 -t $t)
+		got=$(./csimreplay -s $1 -E $2 -b $3 -t $t)
+		[ "$want" = "$got" ] || fail "csimreplay -s $1 -E $2 -b $3 -t $t:" \
+			"$got, csim $want"
+	done
+done
+exported=$(nm -D --defined-only libcsim.so | awk '$2 ~ /^[TDBR]$/ { print $3 }' \
+	| grep -v '^csim')
+[ -z "$exported" ] || fail "libcsim.so exports" $exported
+
+#
+# Checkpoints: a fast-forward that ends inside a sampling skip still stops
+# there, so resuming simulates exactly the rest of the trace
+#
+checkpoint=$(mktemp)
+./csim -s 4 -E 2 -b 4 -t traces/long.trace --skip 1000 \
+	--checkpoint-after 500 --checkpoint $checkpoint > /dev/null
+want=$(tail -n +501 traces/long.trace | counts -s 4 -E 2 -b 4 -t -)
+got=$(counts -s 4 -E 2 -b 4 -t traces/long.trace --restore $checkpoint)
+[ "$want" = "$got" ] || fail "resume after --skip 1000 --checkpoint-after" \
+	"500: $got, rest of the trace $want"
+
+# Saving over the checkpoint a run was restored from, which is still mapped
+# as its cache
+want=$(counts -s 4 -E 2 -b 4 -t traces/long.trace)
+./csim -s 4 -E 2 -b 4 -t traces/long.trace --checkpoint-after 1000 \
+	--checkpoint $checkpoint > /dev/null
+./csim -s 4 -E 2 -b 4 -t traces/long.trace --restore $checkpoint \
+	--checkpoint-after 2000 --checkpoint $checkpoint > /dev/null \
+	|| fail "--restore and --checkpoint of one file exited $?"
+got=$(counts -s 4 -E 2 -b 4 -t traces/long.trace --restore $checkpoint)
+[ "$want" = "$got" ] || fail "resume from a checkpoint saved over its" \
+	"restore: $got, whole trace $want"
+rm -f $checkpoint $checkpoint.tmp
+
+#
+# Page walks: the page table's entries sit far above the trace's addresses
+# and never alias them, however few bits a cache's tags start at
+#
+got=$(./csim -s 1 -E 4 -b 1 --tlb 4:4 --page-walk -t traces/pagewalk.trace \
+	| grep -v '^$' | tail -n 2 | tr '\n' ' ')
+want="Page walks: cache accesses:8 misses:8 hits:0 misses:10 evictions:6 "
+[ "$got" = "$want" ] || fail "page walks on traces/pagewalk.trace: $got"
+
+#
+# Set sampling: every access is counted, and the miss ratio of a full run
+# lies inside the interval the estimate gives
+#
+for config in "10 2 4 8" "10 2 4 4" "12 1 3 4" "9 2 6 4" "14 1 4 16"; do
+	set -- $config
+	want=$(counts -s $1 -E $2 -b $3 -t traces/long.trace)
+	got=$(./csim -s $1 -E $2 -b $3 --set-sample $4 -t traces/long.trace)
+	verdict=$(printf '%s\n%s\n' "$want" "$got" | awk -F'[ :]+' '
+		NR == 1 { accesses = $2 + $4; ratio = $4 / accesses }
+		/^Set sampling/ { counted = $7 }
+		/^Miss ratio/ { low = $3 - $5; high = $3 + $5 }
+		END {
+			if (counted != accesses) print "counted", counted, "of",
+				accesses, "accesses"
+			else if (ratio < low || ratio > high) print "miss ratio",
+				ratio, "outside", low, "to", high
+		}')
+	[ -z "$verdict" ] || fail "--set-sample $4 -s $1 -E $2 -b $3: $verdict"
+done
+
+#
+# Split accesses: one at the top of memory wraps round to block 0, with or
+# without set sampling
+#
+got=$(counts -s 2 -E 1 -b 2 -t traces/wrap.trace --split-accesses)
+[ "$got" = "hits:2 misses:2 evictions:0" ] \
+	|| fail "--split-accesses across the top of memory: $got"
+got=$(./csim -s 2 -E 1 -b 2 -t traces/wrap.trace --split-accesses \
+	--set-sample 2 | awk -F '[ :]+' '/^Set sampling/ { print $7 }')
+[ "$got" = 4 ] || fail "--split-accesses --set-sample across the top of" \
+	"memory: $got accesses counted"
+
+#
+# DRAM: a channel never holds more than --dram-queue requests, so a trace
+# that misses faster than memory keeps up stalls rather than piling up
+#
+for depth in 1 4 32; do
+	got=$(./csim -s 4 -E 2 -b 6 -t traces/long.trace --dram 1:1:8:2048 \
+		--dram-queue $depth | sed -n 's/.*max-queued:\([0-9]*\).*/\1/p')
+	[ -n "$got" ] && [ "$got" -lt $depth ] \
+		|| fail "--dram-queue $depth: max-queued $got"
+done
+
+#
+# Compressed traces: one cut short is reported as truncated, not as a
+# malformed record where the data stops
+#
+truncated=$(mktemp)
+gzip -c traces/long.trace | head -c 50000 > $truncated
+got=$(./csim -s 4 -E 1 -b 4 -t $truncated)
+[ "$got" = "Error: $truncated is truncated or corrupt" ] \
+	|| fail "truncated gzip trace: $got"
+
+#
+# zstd traces, when built with ZSTD=1: one large frame is streamed, with or
+# without its size recorded, small frames are decompressed in parallel, and
+# a cut short trace is still reported
+#
+if [ "$ZSTD" = 1 ]; then
+	want=$(counts -s 4 -E 1 -b 4 -t traces/long.trace)
+	compressed=$(mktemp)
+	for form in "" --no-content-size; do
+		zstd -q -c $form traces/long.trace > $compressed
+		got=$(counts -s 4 -E 1 -b 4 -t $compressed)
+		[ "$want" = "$got" ] || fail "zstd $form trace: $got, plain $want"
+	done
+	split -b 100000 traces/long.trace $compressed.part.
+	for part in $compressed.part.*; do
+		zstd -q -c $part
+	done > $compressed
+	rm -f $compressed.part.*
+	got=$(counts -s 4 -E 1 -b 4 -t $compressed)
+	[ "$want" = "$got" ] || fail "zstd trace of small frames: $got," \
+		"plain $want"
+	zstd -q -c traces/long.trace | head -c 20000 > $truncated
+	got=$(./csim -s 4 -E 1 -b 4 -t $truncated)
+	[ "$got" = "Error: $truncated is truncated or corrupt" ] \
+		|| fail "truncated zstd trace: $got"
+	rm -f $compressed
+fi
+rm -f $truncated
+
+if [ $failures -ne 0 ]; then
+	echo "$failures checks failed"
+	exit 1
+fi
+echo "All checks passed"
@@ -0,0 +1,162 @@
+/*
+ * checkpoint.c
+ *
+ * A checkpoint is a small header followed, at a page boundary, by the raw
+ * Line array of the cache. Restoring maps the file privately and points the
+ * sets straight into the mapping, so even a very large cache comes back
+ * instantly and many runs can branch from the same warm state.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "checkpoint.h"
+
+
+
+/**
+ * Writes the cache and the run state that goes with it.
+ *
+ * @param path File to write
+ * @param cache The cache to save
+ * @param info Geometry, counters and trace position
+ * @return 0 on success, -1 on error
+ */
+int saveCheckpoint(const char *path, Set *cache, const checkpoint_t *info) {
+	checkpoint_header_t header;
+	long page = sysconf(_SC_PAGESIZE);
+	size_t num_lines = ((size_t)1 << info->set_bits) * info->lines_per_set;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+	header.version = CHECKPOINT_VERSION;
+	header.line_size = sizeof(Line);
+	header.set_bits = info->set_bits;
+	header.lines_per_set = info->lines_per_set;
+	header.block_bits = info->block_bits;
+	header.hits = info->hits;
+	header.misses = info->misses;
+	header.evictions = info->evictions;
+	header.records = info->records;
+	header.trace_offset = info->trace_offset;
+	header.lines_offset = (sizeof(header) + page - 1) / page * page;
+	header.lines_size = num_lines * sizeof(Line);
+
+	// Written beside path and renamed over it once complete, so a crash
+	// leaves the old checkpoint whole, and a cache restored from path,
+	// which is still mapped from it, is never truncated underneath us
+	size_t path_length = strlen(path);
+	char *temp_path = malloc(path_length + sizeof(".tmp"));
+	if (temp_path == NULL) {
+		return -1;
+	}
+	memcpy(temp_path, path, path_length);
+	memcpy(temp_path + path_length, ".tmp", sizeof(".tmp"));
+	FILE *fp = fopen(temp_path, "wb");
+	if (fp == NULL) {
+		free(temp_path);
+		return -1;
+	}
+	cacheSync(cache);
+
+	// Lines of a dense cache are contiguous, starting at the first set's.
+	// A sparse one is written set by set, untouched sets as empty ones, so
+	// it is restored as a dense cache.
+	int ok = fwrite(&header, sizeof(header), 1, fp) == 1
+		&& fseek(fp, header.lines_offset, SEEK_SET) == 0;
+	if (!cacheArena(cache)->sparse) {
+		ok = ok && fwrite(cache[0].Lines, sizeof(Line), num_lines, fp)
+			== num_lines;
+	} else if (ok) {
+		size_t set, num_sets = (size_t)1 << info->set_bits;
+		Line *empty = malloc(info->lines_per_set * sizeof(Line));
+		if (empty == NULL) {
+			fclose(fp);
+			unlink(temp_path);
+			free(temp_path);
+			return -1;
+		}
+		cacheInitLines(empty, info->lines_per_set);
+		for (set = 0; ok && set < num_sets; set++) {
+			ok = fwrite(cache[set].Lines != NULL ? cache[set].Lines : empty,
+					sizeof(Line), info->lines_per_set, fp)
+				== (size_t)info->lines_per_set;
+		}
+		free(empty);
+	}
+
+	ok = ok && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+	if (fclose(fp) != 0) {
+		ok = 0;
+	}
+	if (ok && rename(temp_path, path) != 0) {
+		ok = 0;
+	}
+	if (!ok) {
+		unlink(temp_path);
+	}
+	free(temp_path);
+	return ok ? 0 : -1;
+}
+
+
+
+/**
+ * Maps a checkpoint back in as a cache.
+ *
+ * @param path File to read
+ * @param info Receives geometry, counters and trace position
+ * @return The cache, to be released with freeCache, or NULL on error
+ */
+Set *restoreCheckpoint(const char *path, checkpoint_t *info) {
+	checkpoint_header_t header;
+	struct stat st;
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	if (pread(fd, &header, sizeof(header), 0) != sizeof(header)
+			|| memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic))
+			|| header.version != CHECKPOINT_VERSION
+			|| header.line_size != sizeof(Line)
+			|| header.set_bits < 0 || header.set_bits > 30
+			|| header.lines_per_set <= 0
+			|| header.lines_size != ((uint64_t)1 << header.set_bits)
+				* header.lines_per_set * sizeof(Line)
+			|| fstat(fd, &st) != 0
+			|| (uint64_t)st.st_size < header.lines_offset + header.lines_size) {
+		close(fd);
+		return NULL;
+	}
+
+	size_t length = header.lines_offset + header.lines_size;
+	void *base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+			fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		return NULL;
+	}
+
+	info->set_bits = header.set_bits;
+	info->lines_per_set = header.lines_per_set;
+	info->block_bits = header.block_bits;
+	info->hits = header.hits;
+	info->misses = header.misses;
+	info->evictions = header.evictions;
+	info->records = header.records;
+	info->trace_offset = header.trace_offset;
+
+	Set *cache = createMappedCache((Line *)((char *)base
+				+ header.lines_offset), 1 << header.set_bits,
+			header.lines_per_set, base, length);
+	if (cache == NULL) {
+		munmap(base, length);
+	}
+	return cache;
+}
@@ -0,0 +1,61 @@
+/*
+ * checkpoint.h - Saving and restoring the complete state of a cache
+ */
+
+#ifndef CSIM_CHECKPOINT_H
+#define CSIM_CHECKPOINT_H
+
+#include <stdint.h>
+#include "cache.h"
+
+#define CHECKPOINT_MAGIC "CSIMCKP1"
+#define CHECKPOINT_VERSION 2
+
+/*
+ * On-disk header. The lines follow at lines_offset, which is page aligned
+ * so the file can be mapped and used as the cache without copying.
+ */
+typedef struct checkpoint_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t line_size;     /* sizeof(Line), guards against layout changes */
+	int32_t set_bits;
+	int32_t lines_per_set;
+	int32_t block_bits;
+	int32_t reserved;
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+	uint64_t records;       /* trace records simulated so far */
+	uint64_t trace_offset;  /* byte offset of the next trace record, or -1
+	                           when the trace was a stream */
+	uint64_t lines_offset;
+	uint64_t lines_size;
+} checkpoint_header_t;
+
+// Everything besides the lines that a checkpoint records
+typedef struct checkpoint {
+	int set_bits;
+	int lines_per_set;
+	int block_bits;
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long evictions;
+	unsigned long records;
+	long trace_offset;
+} checkpoint_t;
+
+/*
+ * saveCheckpoint - Write the cache and info to path.tmp, then rename it
+ *     over path. Returns 0, or -1 on error, leaving path as it was.
+ */
+int saveCheckpoint(const char *path, Set *cache, const checkpoint_t *info);
+
+/*
+ * restoreCheckpoint - Map the checkpoint at path as a cache and fill in
+ *     info. Pages are copy-on-write, so the file itself never changes.
+ *     Returns NULL if the file is missing, truncated or not a checkpoint.
+ */
+Set *restoreCheckpoint(const char *path, checkpoint_t *info);
+
+#endif /* CSIM_CHECKPOINT_H */
@@ -0,0 +1,550 @@
+/*
+ * coherence.c
+ *
+ * Several cores, each with a private cache from cache.c, kept coherent
+ * with MSI, MESI or MOESI. Requests are atomic: each access finishes all
+ * of its coherence actions before the next one starts. An M is a load
+ * followed by a store, as in the single cache.
+ *
+ * The directory is a full map. It is derived from the caches themselves,
+ * so both interconnects produce the same states and misses and differ
+ * only in the traffic counted: a snooping bus looks up the block in every
+ * other cache for each request, a directory sends messages only to the
+ * caches that hold it.
+ *
+ * False sharing is found from a mask of the bytes each core has written
+ * to each of its lines. Offending blocks are counted in a Space-Saving
+ * sketch, so memory stays fixed however many blocks a trace touches.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "coherence.h"
+#include "events.h"
+
+// Sketch entries kept for each block that is reported
+#define SKETCH_PER_TOP 8
+#define MIN_SKETCH_SIZE 64
+
+// Line states. STATE_INVALIDATED is I, but remembers that the block was
+// taken by another core rather than evicted, to tell coherence misses.
+enum line_state {
+	STATE_I,
+	STATE_INVALIDATED,
+	STATE_S,
+	STATE_E,
+	STATE_O,
+	STATE_M
+};
+
+// Letter for each state, for verbose output
+static const char state_names[] = "IISEOM";
+
+// Longest verbose line: "c<core> M <16 hex>,<int> miss miss eviction
+// upgrade <state>\n"
+#define EVENT_MAX_CORE_LINE 96
+
+struct multicore {
+	int cores;
+	int set_bits;
+	int lines_per_set;
+	int block_bits;
+	enum coherence_protocol protocol;
+	enum interconnect interconnect;
+	Set *caches[MAX_CORES];
+	unsigned char *states[MAX_CORES];  /* per line, set * lines_per_set + way */
+	core_stats_t core_stats[MAX_CORES];
+	coherence_stats_t stats;
+
+	// False sharing, when tracked
+	uint64_t *written[MAX_CORES];  /* per line, a bit per byte_shift bytes */
+	int byte_shift;
+	sharing_entry_t *sketch;
+	int sketch_size, sketch_used;
+};
+
+
+
+/**
+ * Creates the caches of every core.
+ *
+ * @param cores Number of cores, up to MAX_CORES
+ * @param set_bits Number of set index bits
+ * @param lines_per_set Number of lines per cache set
+ * @param block_bits Number of block offset bits
+ * @param protocol Coherence protocol
+ * @param interconnect Snooping bus or directory
+ * @return The caches, to be released with multicoreFree
+ */
+multicore_t *multicoreCreate(int cores, int set_bits, int lines_per_set,
+		int block_bits, enum coherence_protocol protocol,
+		enum interconnect interconnect) {
+	multicore_t *mc = calloc(1, sizeof(multicore_t));
+	size_t num_lines = ((size_t)1 << set_bits) * lines_per_set;
+	int c;
+
+	if (mc == NULL) {
+		printf("Error allocating caches\n");
+		exit(1);
+	}
+	mc->cores = cores;
+	mc->set_bits = set_bits;
+	mc->lines_per_set = lines_per_set;
+	mc->block_bits = block_bits;
+	mc->protocol = protocol;
+	mc->interconnect = interconnect;
+	for (c = 0; c < cores; c++) {
+		mc->caches[c] = createCache(1 << set_bits, lines_per_set);
+		mc->states[c] = calloc(num_lines, 1);
+		if (mc->caches[c] == NULL || mc->states[c] == NULL) {
+			printf("Error allocating caches\n");
+			exit(1);
+		}
+	}
+	return mc;
+}
+
+
+
+/**
+ * Starts tracking false sharing.
+ *
+ * @param mc The caches
+ * @param top Number of blocks that will be reported
+ */
+void multicoreTrackSharing(multicore_t *mc, int top) {
+	size_t num_lines = ((size_t)1 << mc->set_bits) * mc->lines_per_set;
+	int c;
+
+	// Blocks over 64 bytes get a bit per group of bytes
+	mc->byte_shift = mc->block_bits > 6 ? mc->block_bits - 6 : 0;
+	mc->sketch_size = top * SKETCH_PER_TOP;
+	if (mc->sketch_size < MIN_SKETCH_SIZE) {
+		mc->sketch_size = MIN_SKETCH_SIZE;
+	}
+	mc->sketch = calloc(mc->sketch_size, sizeof(sharing_entry_t));
+	if (mc->sketch == NULL) {
+		printf("Error allocating false sharing sketch\n");
+		exit(1);
+	}
+	for (c = 0; c < mc->cores; c++) {
+		mc->written[c] = calloc(num_lines, sizeof(uint64_t));
+		if (mc->written[c] == NULL) {
+			printf("Error allocating false sharing masks\n");
+			exit(1);
+		}
+	}
+}
+
+
+
+/**
+ * Returns the mask of the bytes an access covers in its block, cut off at
+ * the end of the block.
+ */
+static uint64_t writeMask(const multicore_t *mc, mem_addr address,
+		int size) {
+	mem_addr block_size = 1UL << mc->block_bits;
+	mem_addr offset = address & (block_size - 1);
+	mem_addr end = offset + size < block_size ? offset + size : block_size;
+	int first = (int)(offset >> mc->byte_shift);
+	int last = (int)((end - 1) >> mc->byte_shift);
+
+	uint64_t high = last == 63 ? ~0ULL : (1ULL << (last + 1)) - 1;
+	return high & ~((1ULL << first) - 1);
+}
+
+
+
+/**
+ * Counts one false sharing invalidation of a block in the sketch. A block
+ * that isn't in it replaces the one with the lowest count and inherits
+ * that count as its possible error, as in Space-Saving.
+ *
+ * @param mc The caches
+ * @param block Address of the block
+ * @param cores The cores involved
+ */
+static void countSharing(multicore_t *mc, mem_addr block,
+		unsigned long long cores) {
+	sharing_entry_t *entry = NULL;
+	int i;
+
+	for (i = 0; i < mc->sketch_used; i++) {
+		if (mc->sketch[i].block == block) {
+			entry = &mc->sketch[i];
+			break;
+		}
+	}
+	if (entry == NULL && mc->sketch_used < mc->sketch_size) {
+		entry = &mc->sketch[mc->sketch_used++];
+		entry->block = block;
+	} else if (entry == NULL) {
+		entry = &mc->sketch[0];
+		for (i = 1; i < mc->sketch_used; i++) {
+			if (mc->sketch[i].invalidations < entry->invalidations) {
+				entry = &mc->sketch[i];
+			}
+		}
+		entry->block = block;
+		entry->error = entry->invalidations;
+		entry->cores = 0;
+	}
+	entry->invalidations++;
+	entry->cores |= cores;
+}
+
+
+
+/**
+ * Orders sketch entries by invalidations, most first.
+ */
+static int compareSharing(const void *a, const void *b) {
+	const sharing_entry_t *ea = a, *eb = b;
+	if (ea->invalidations != eb->invalidations) {
+		return ea->invalidations > eb->invalidations ? -1 : 1;
+	}
+	return ea->block < eb->block ? -1 : ea->block > eb->block;
+}
+
+
+
+/**
+ * Copies out the blocks with the most false sharing invalidations.
+ *
+ * @param mc The caches
+ * @param entries Receives the blocks
+ * @param max Most blocks to copy
+ * @return Number of blocks copied
+ */
+int multicoreFalseSharing(const multicore_t *mc, sharing_entry_t *entries,
+		int max) {
+	if (mc->sketch == NULL) {
+		return 0;
+	}
+	sharing_entry_t *sorted = malloc(mc->sketch_used
+			* sizeof(sharing_entry_t) + 1);
+	if (sorted == NULL) {
+		printf("Error allocating false sharing report\n");
+		exit(1);
+	}
+	memcpy(sorted, mc->sketch, mc->sketch_used * sizeof(sharing_entry_t));
+	qsort(sorted, mc->sketch_used, sizeof(sharing_entry_t), compareSharing);
+	int n = mc->sketch_used < max ? mc->sketch_used : max;
+	memcpy(entries, sorted, n * sizeof(sharing_entry_t));
+	free(sorted);
+	return n;
+}
+
+
+
+/**
+ * Counts the traffic of one request from a core. A snooping bus checks
+ * every other cache; a directory exchanges a request and a reply with the
+ * home node, and a message and an acknowledgement with each cache it has
+ * to involve.
+ *
+ * @param mc The caches
+ * @param involved Number of other caches that had to act
+ */
+static void countRequest(multicore_t *mc, int involved) {
+	if (mc->interconnect == INTERCONNECT_SNOOP) {
+		mc->stats.snoops += mc->cores - 1;
+	} else {
+		mc->stats.messages += 2 + 2 * involved;
+	}
+}
+
+
+
+/**
+ * Invalidates a block in every cache but one.
+ *
+ * @param mc The caches
+ * @param core The core that keeps the block
+ * @param set The set of the block
+ * @param tag The tag of the block
+ * @param supply Whether an owner has to supply the data, on a write miss
+ * @param write_mask Bytes of the block the write that causes it covers
+ * @param block Address of the block
+ * @return Number of caches that held it
+ */
+static int invalidateOthers(multicore_t *mc, int core, int set,
+		mem_addr tag, int supply, uint64_t write_mask, mem_addr block) {
+	int c, way, involved = 0;
+
+	for (c = 0; c < mc->cores; c++) {
+		if (c == core) {
+			continue;
+		}
+		way = cacheLookup(mc->caches[c], mc->lines_per_set, set, tag);
+		if (way < 0) {
+			continue;
+		}
+		unsigned char *state =
+			&mc->states[c][(size_t)set * mc->lines_per_set + way];
+		if (supply && (*state == STATE_M || *state == STATE_O)) {
+			// The owner passes the data on instead of writing it back
+			mc->core_stats[c].transfers++;
+		}
+		if (mc->sketch != NULL) {
+			uint64_t *written =
+				&mc->written[c][(size_t)set * mc->lines_per_set + way];
+			if (*written != 0 && (*written & write_mask) == 0) {
+				mc->stats.false_sharing++;
+				mc->core_stats[c].false_sharing++;
+				countSharing(mc, block, (1ULL << c) | (1ULL << core));
+			}
+			*written = 0;
+		}
+		cacheInvalidate(mc->caches[c], mc->lines_per_set, set, way);
+		*state = STATE_INVALIDATED;
+		mc->core_stats[c].invalidations++;
+		involved++;
+	}
+	return involved;
+}
+
+
+
+/**
+ * Brings a block into a core's cache after a miss, evicting if needed.
+ *
+ * @param mc The caches
+ * @param core The core that missed
+ * @param set The set of the block
+ * @param tag The tag of the block
+ * @param new_state State of the line once filled
+ * @return The line number in the set
+ */
+static int fillLine(multicore_t *mc, int core, int set, mem_addr tag,
+		enum line_state new_state) {
+	Set *cache = mc->caches[core];
+	unsigned char *states = &mc->states[core][(size_t)set * mc->lines_per_set];
+	core_stats_t *st = &mc->core_stats[core];
+	Line *lines = cache[set].Lines;
+	int i;
+
+	st->misses++;
+
+	// A block another core took is still tagged in an invalid line
+	for (i = 0; i < mc->lines_per_set; i++) {
+		if (!lines[i].valid && states[i] == STATE_INVALIDATED
+				&& lines[i].tag == tag) {
+			st->coherence_misses++;
+			break;
+		}
+	}
+
+	int way = cacheVictim(cache, mc->lines_per_set, set);
+	if (lines[way].valid) {
+		st->evictions++;
+		if (states[way] == STATE_M || states[way] == STATE_O) {
+			st->writebacks++;
+			if (mc->interconnect == INTERCONNECT_DIRECTORY) {
+				mc->stats.messages++;
+			}
+		}
+	}
+	cacheFill(cache, mc->lines_per_set, set, way, tag);
+	states[way] = new_state;
+	if (mc->sketch != NULL) {
+		mc->written[core][(size_t)set * mc->lines_per_set + way] = 0;
+	}
+	return way;
+}
+
+
+
+/**
+ * Simulates a load.
+ *
+ * @return The state of the line afterwards, and sets *hit
+ */
+static enum line_state load(multicore_t *mc, int core, int set,
+		mem_addr tag, int *hit) {
+	Set *cache = mc->caches[core];
+	unsigned char *states = mc->states[core];
+	size_t base = (size_t)set * mc->lines_per_set;
+	int way = cacheLookup(cache, mc->lines_per_set, set, tag);
+	int c, sharers = 0, involved = 0;
+
+	if (way >= 0) {
+		*hit = 1;
+		mc->core_stats[core].hits++;
+		updateLRU(cache, set, cache[set].Lines[way].lru, mc->lines_per_set);
+		return states[base + way];
+	}
+
+	// Read miss: owners supply the data and give up exclusivity
+	*hit = 0;
+	mc->stats.reads++;
+	for (c = 0; c < mc->cores; c++) {
+		if (c == core) {
+			continue;
+		}
+		int w = cacheLookup(mc->caches[c], mc->lines_per_set, set, tag);
+		if (w < 0) {
+			continue;
+		}
+		unsigned char *state = &mc->states[c][base + w];
+		sharers++;
+		if (*state == STATE_M) {
+			mc->core_stats[c].transfers++;
+			if (mc->protocol == PROTOCOL_MOESI) {
+				*state = STATE_O;
+			} else {
+				mc->core_stats[c].writebacks++;
+				*state = STATE_S;
+			}
+			involved++;
+		} else if (*state == STATE_O) {
+			mc->core_stats[c].transfers++;
+			involved++;
+		} else if (*state == STATE_E) {
+			*state = STATE_S;
+			involved++;
+		}
+	}
+	countRequest(mc, involved);
+
+	enum line_state new_state = STATE_S;
+	if (sharers == 0 && mc->protocol != PROTOCOL_MSI) {
+		new_state = STATE_E;
+	}
+	fillLine(mc, core, set, tag, new_state);
+	return new_state;
+}
+
+
+
+/**
+ * Simulates a store.
+ *
+ * @param write_mask Bytes of the block written
+ * @param block Address of the block
+ * @return The state of the line afterwards, and sets *hit and *upgrade
+ */
+static enum line_state store(multicore_t *mc, int core, int set,
+		mem_addr tag, uint64_t write_mask, mem_addr block, int *hit,
+		int *upgrade) {
+	Set *cache = mc->caches[core];
+	unsigned char *states = mc->states[core];
+	size_t base = (size_t)set * mc->lines_per_set;
+	int way = cacheLookup(cache, mc->lines_per_set, set, tag);
+
+	*upgrade = 0;
+	if (way >= 0) {
+		*hit = 1;
+		mc->core_stats[core].hits++;
+		updateLRU(cache, set, cache[set].Lines[way].lru, mc->lines_per_set);
+
+		// Shared copies elsewhere have to go before writing
+		if (states[base + way] == STATE_S || states[base + way] == STATE_O) {
+			*upgrade = 1;
+			mc->stats.upgrades++;
+			mc->core_stats[core].upgrades++;
+			countRequest(mc, invalidateOthers(mc, core, set, tag, 0,
+						write_mask, block));
+		}
+		states[base + way] = STATE_M;
+	} else {
+		// Write miss: take the block from everyone else
+		*hit = 0;
+		mc->stats.read_exclusives++;
+		countRequest(mc, invalidateOthers(mc, core, set, tag, 1, write_mask,
+					block));
+		way = fillLine(mc, core, set, tag, STATE_M);
+	}
+
+	if (mc->sketch != NULL) {
+		mc->written[core][base + way] |= write_mask;
+	}
+	return STATE_M;
+}
+
+
+
+/**
+ * Simulates one access by one core.
+ *
+ * @param mc The caches
+ * @param core The core making the access
+ * @param operation 'L', 'S' or 'M'; anything else does nothing
+ * @param address Memory location of the access
+ * @param size Number of bytes accessed
+ * @param verbose A flag which is set for verbose mode
+ */
+void multicoreAccess(multicore_t *mc, int core, char operation,
+		mem_addr address, int size, int verbose) {
+	int set = (int)((address >> mc->block_bits)
+			& ((1UL << mc->set_bits) - 1));
+	mem_addr tag = address >> (mc->block_bits + mc->set_bits);
+	core_stats_t *st = &mc->core_stats[core];
+	unsigned long evictions = st->evictions;
+	enum line_state state = STATE_I;
+	int load_hit = 0, store_hit = 0, upgrade = 0;
+
+	if (operation != 'L' && operation != 'S' && operation != 'M') {
+		return;
+	}
+	if (operation != 'S') {
+		state = load(mc, core, set, tag, &load_hit);
+	}
+	if (operation != 'L') {
+		state = store(mc, core, set, tag, writeMask(mc, address, size),
+				address >> mc->block_bits << mc->block_bits, &store_hit,
+				&upgrade);
+	}
+
+	// Printing for verbose mode, through the buffered event stream
+	if (verbose) {
+		char line[EVENT_MAX_CORE_LINE];
+		int len = snprintf(line, sizeof(line), "c%d %c %lx,%d%s%s%s%s %c\n",
+				core, operation, address, size,
+				operation == 'S' ? "" : load_hit ? " hit" : " miss",
+				operation == 'L' ? "" : store_hit ? " hit" : " miss",
+				st->evictions != evictions ? " eviction" : "",
+				upgrade ? " upgrade" : "", state_names[state]);
+		eventText(line, len);
+	}
+}
+
+
+
+/**
+ * Returns the counts of one core.
+ */
+const core_stats_t *multicoreCoreStats(const multicore_t *mc, int core) {
+	return &mc->core_stats[core];
+}
+
+
+
+/**
+ * Returns the interconnect traffic.
+ */
+const coherence_stats_t *multicoreStats(const multicore_t *mc) {
+	return &mc->stats;
+}
+
+
+
+/**
+ * Frees every cache.
+ *
+ * @param mc The caches
+ */
+void multicoreFree(multicore_t *mc) {
+	int c;
+
+	for (c = 0; c < mc->cores; c++) {
+		freeCache(mc->caches[c], 1 << mc->set_bits);
+		free(mc->states[c]);
+		free(mc->written[c]);
+	}
+	free(mc->sketch);
+	free(mc);
+}
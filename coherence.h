@@ -0,0 +1,93 @@
+/*
+ * coherence.h - Private caches of several cores kept coherent
+ */
+
+#ifndef CSIM_COHERENCE_H
+#define CSIM_COHERENCE_H
+
+#include "cache.h"
+
+// The most cores a run can simulate
+#define MAX_CORES 64
+
+enum coherence_protocol {
+	PROTOCOL_MSI,
+	PROTOCOL_MESI,
+	PROTOCOL_MOESI
+};
+
+// How coherence requests reach the other caches
+enum interconnect {
+	INTERCONNECT_SNOOP,     /* broadcast on a shared bus */
+	INTERCONNECT_DIRECTORY  /* sent only to the caches holding the block */
+};
+
+// Counts for one core
+typedef struct core_stats {
+	unsigned long hits, misses, evictions;
+	unsigned long coherence_misses;  /* misses on blocks another core took */
+	unsigned long invalidations;     /* lines this cache lost to others */
+	unsigned long upgrades;          /* writes to shared lines */
+	unsigned long writebacks;        /* dirty data written to memory */
+	unsigned long transfers;         /* blocks this cache supplied */
+	unsigned long false_sharing;     /* invalidations by disjoint writes */
+} core_stats_t;
+
+// Interconnect traffic
+typedef struct coherence_stats {
+	unsigned long reads;             /* read misses */
+	unsigned long read_exclusives;   /* write misses */
+	unsigned long upgrades;          /* invalidations without data */
+	unsigned long snoops;            /* lookups in other caches */
+	unsigned long messages;          /* directory messages */
+	unsigned long false_sharing;     /* invalidations by disjoint writes */
+} coherence_stats_t;
+
+// A block that false sharing invalidated, from the top-K sketch
+typedef struct sharing_entry {
+	mem_addr block;               /* address of the block */
+	unsigned long invalidations;  /* estimate, never below the true count */
+	unsigned long error;          /* how far over the true count it can be */
+	unsigned long long cores;     /* bit per core involved */
+} sharing_entry_t;
+
+typedef struct multicore multicore_t;
+
+/*
+ * multicoreCreate - Create cores caches of (set_bits, lines_per_set,
+ *     block_bits), all empty.
+ */
+multicore_t *multicoreCreate(int cores, int set_bits, int lines_per_set,
+		int block_bits, enum coherence_protocol protocol,
+		enum interconnect interconnect);
+
+/*
+ * multicoreTrackSharing - Record the bytes each core writes to each line,
+ *     and count an invalidation as false sharing when the write causing it
+ *     and the writes of the core losing the line don't overlap. The worst
+ *     blocks are kept in a sketch of a few times top entries.
+ */
+void multicoreTrackSharing(multicore_t *mc, int top);
+
+/*
+ * multicoreFalseSharing - Fill entries with up to max blocks, most
+ *     invalidations first. Returns how many were filled.
+ */
+int multicoreFalseSharing(const multicore_t *mc, sharing_entry_t *entries,
+		int max);
+
+/*
+ * multicoreAccess - Simulate an L, S or M by one core. With verbose set,
+ *     prints the outcome and the resulting state of the line.
+ */
+void multicoreAccess(multicore_t *mc, int core, char operation,
+		mem_addr address, int size, int verbose);
+
+/* Counts of one core, and of the interconnect */
+const core_stats_t *multicoreCoreStats(const multicore_t *mc, int core);
+const coherence_stats_t *multicoreStats(const multicore_t *mc);
+
+/* Free every cache */
+void multicoreFree(multicore_t *mc);
+
+#endif /* CSIM_COHERENCE_H */
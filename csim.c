@@ -16,46 +16,105 @@
 #include <getopt.h>
 #include <unistd.h>
 #include "cachelab.h"
-
-//Type def's to sooth carpal tunnel
-typedef unsigned long int mem_addr;
-typedef struct Line Line;
-typedef struct Set Set;
-
-//Struct to hold individual line of cache
-struct Line {
-	unsigned int valid;
-	unsigned int tag;
-	unsigned int lru;
-};
-
-//Struct to hold a set of lines
-struct Set {
-	Line *Lines;
+#include "cache.h"
+#include "events.h"
+#include "perf.h"
+#include "checkpoint.h"
+#include "tracein.h"
+#include "parse.h"
+#include "coherence.h"
+#include "tlb.h"
+#include "latency.h"
+#include "dram.h"
+#include "packed.h"
+#include "lockstep.h"
+
+// Optional behaviour of a run, filled in from the command line
+typedef struct sim_options {
+	char *checkpoint_file;          /* save the cache here when done */
+	unsigned long checkpoint_after; /* stop after this many records, 0 = all */
+	char *restore_file;             /* start from this checkpoint */
+	unsigned long skip;             /* records fast-forwarded per period */
+	unsigned long warm;             /* records functionally warmed per period */
+	unsigned long measure;          /* records measured per period, 0 = all */
+	unsigned int set_sample;        /* simulate 1 in this many sets, 0 = all */
+	int parse_threads;              /* threads parsing a plain trace file */
+	int skip_malformed;             /* skip bad records instead of stopping */
+	int split_accesses;             /* one access per block an access covers */
+	int protocol;                   /* coherence protocol, -1 = one cache */
+	int cores;                      /* cores in a merged multicore trace */
+	enum interconnect interconnect; /* snooping bus or directory */
+	int false_sharing;              /* blocks to report, 0 = don't track */
+	tlb_config_t tlb;               /* TLB geometry, no L1 entries = no TLB */
+	int page_walk;                  /* page walks read through the cache */
+	int model_latency;              /* count cycles as well as hits */
+	latency_config_t latency;       /* cycles per step and the MLP window */
+	dram_config_t dram;             /* memory behind the cache, 0 channels
+	                                   = none */
+	char *dram_bandwidth_file;      /* bytes per epoch as CSV */
+	int sparse;                     /* give sets lines on first touch */
+	int packed;                     /* keep the cache in packed form */
+	lockstep_config_t *sweep;       /* more caches run alongside this one */
+	int sweep_count;
+} sim_options_t;
+
+// Sets simulated by --set-sample, and what is counted to scale them up
+typedef struct set_sample {
+	unsigned int mask;              /* a set's hash must clear this */
+	unsigned int count;             /* number of sampled sets */
+	unsigned int *sets;             /* the sampled sets in order; set i is
+	                                   simulated in slot i of the cache */
+	int slot_bits;                  /* set bits of the smaller cache */
+	unsigned int *misses;           /* measured misses of each slot */
+	unsigned long accesses;         /* measured accesses of every set, in
+	                                   units of hits plus misses */
+} set_sample_t;
+
+// Malformed records reported one by one in skip mode, the rest are counted
+#define MAX_MALFORMED_REPORTS 10
+
+// Records handed to the swept caches at a time
+#define SWEEP_BATCH_SIZE 256
+
+// Records a plain run hands the cache model at a time
+#define SERIAL_BATCH_SIZE 256
+
+// Where a run is in its skip, warm, measure cycle
+enum sample_phase {
+	PHASE_SKIP,
+	PHASE_WARM,
+	PHASE_MEASURE
 };
 
 // forward declaration
+enum access_outcome backedOperation(Set *cache, unsigned char *dirty,
+		dram_t *dram, unsigned long long arrival, int set_bits,
+		int block_bits, int lines_per_set, char operation, mem_addr address,
+		int size, int verbose, int *hit_count, int *miss_count,
+		int *eviction_count);
 void simulateCache(char *trace_file, int num_sets, int block_size,
-	   	int lines_per_set, int verbose);
-void operationL (Set *cache, int lines_per_set, mem_addr address,
-	   	int size, int verbose, int set, int tag, int *hit_count,
-	   	int *miss_count, int *eviction_count); 
-void operationS (Set *cache, int lines_per_set, mem_addr address,
-	   	int size, int verbose, int set, int tag, int *hit_count,
-	   	int *miss_count, int *eviction_count);
-void operationM (Set *cache, int lines_per_set, mem_addr address,
-	   	int size, int verbose, int set, int tag, int *hit_count,
-	   	int *miss_count, int *eviction_count);
-void hit(Set *cache, int lines_per_set, mem_addr address, int i,
-	   	char operation, int size, int verbose, int set, int tag,
-	   	int *hit_count, int *found);
-void miss(Set *cache, int lines_per_set, mem_addr address, int i, 
-		char operation, int size, int verbose, int set, int tag,
-	   	int *hit_count, int *miss_count, int *found);
-void eviction(Set *cache, int lines_per_set, mem_addr address, int i,
-	   	char operation, int size, int verbose, int set, int tag, 
-		int *hit_count, int *miss_count, int *eviction_count, int *found);
-void updateLRU(Set *cache, int set_num, int prev_lru, int lines_per_set);
+	   	int lines_per_set, int verbose, const sim_options_t *options);
+void simulateMulticore(char *trace_files, int num_sets, int block_size,
+		int lines_per_set, int verbose, const sim_options_t *options);
+void simulateSweep(char *trace_file, int num_sets, int block_size,
+		int lines_per_set, const sim_options_t *options);
+int parseSweep(char *list, lockstep_config_t **configs);
+void handleMalformed(const trace_position_t *where,
+		const sim_options_t *options, unsigned long *malformed);
+void traceReadError(const char *name, enum trace_format format);
+void flushBatch(Set *cache, int set_bits, int block_bits, int lines_per_set,
+		const trace_record_t *batch, size_t *buffered, int verbose,
+		int *hit_count, int *miss_count, int *eviction_count);
+unsigned long clampSkip(unsigned long skip, unsigned long records,
+		const sim_options_t *options);
+void printFalseSharing(const multicore_t *mc, int cores, int top);
+unsigned int hashSet(unsigned int set);
+int sampleAccess(Set *cache, set_sample_t *sample, int set_bits,
+		int block_bits, int lines_per_set, char operation, mem_addr address,
+		int size, int split, int counted, int *hit_count, int *miss_count,
+		int *eviction_count);
+void printSetSampleSummary(int miss_count, int eviction_count, int num_sets,
+		const set_sample_t *sample);
 
 
 /**
@@ -64,8 +123,25 @@ void updateLRU(Set *cache, int set_num, int prev_lru, int lines_per_set);
  * @param executable_name String containing the name of the executable.
  */
 void usage(char *executable_name) {
-	printf("Usage: %s [-hv] -s <s> -E <E> -b <b> -t <tracefile>\n",
-		   	executable_name);
+	printf("Usage: %s [-hv] -s <s> -E <E> -b <b> -t <tracefile | ->"
+			" [-l <eventlog>] [--stats-perf] [--perf-counters]"
+			" [--checkpoint <file>] [--checkpoint-after <n>]"
+			" [--restore <file>] [--skip <n>] [--warm <n>]"
+			" [--measure <n>] [--set-sample <n>] [--parse-threads <n>]"
+			" [--malformed <strict|skip>] [--split-accesses]"
+			" [--protocol <msi|mesi|moesi> [--cores <n>]"
+			" [--interconnect <snoop|directory>] [--false-sharing <top>]]"
+			" [--tlb <entries>:<ways>[,<entries>:<ways>]"
+			" [--page-size <4k|2m|1g>] [--page-walk]]"
+			" [--latency <hit>:<miss-penalty>:<memory>[:<tlb>]"
+			" [--mlp <n>]]"
+			" [--dram <channels>:<ranks>:<banks>:<row-bytes>"
+			" [--dram-map <map>] [--dram-timing <cas>:<rcd>:<rp>:<burst>]"
+			" [--dram-epoch <cycles>] [--dram-bandwidth <file>]"
+			" [--dram-queue <depth>]]"
+			" [--sparse] [--no-huge-pages] [--numa-local] [--packed]"
+			" [--sweep <s>:<E>:<b>[,<s>:<E>:<b>...]]\n",
+			executable_name);
 }
 
 
@@ -81,14 +157,58 @@ int main(int argc, char *argv[]) {
 	// Setting initial values
 	int verbose_mode = 0;
 	char *trace_filename = NULL;
+	char *event_log_filename = NULL;
+	sim_options_t options = { NULL, 0, NULL, 0, 0, 0, 0, 0, 0, 0, -1, 0,
+		INTERCONNECT_SNOOP, 0, { 0, 0, 0, 0, PAGE_BITS_4K }, 0, 0,
+		{ 0, 0, 0, 0, 0 }, { 0, 0, 0, 0, 0, "RoRaBaChCo", 14, 14, 14, 4,
+		32, 10000 }, NULL, 0, 0, NULL, 0 };
 
 	int c = -1;
 	
 	int num_sets, block_size, lines_per_set;
 	int s_flag = 0, b_flag = 0, E_flag = 0, t_flag = 0;
+	int huge_pages = 1, numa_local = 0;
+
+	// Long options, mapped onto values that can't clash with short ones
+	static struct option long_options[] = {
+		{"stats-perf", no_argument, NULL, 1000},
+		{"perf-counters", no_argument, NULL, 1001},
+		{"checkpoint", required_argument, NULL, 1002},
+		{"checkpoint-after", required_argument, NULL, 1003},
+		{"restore", required_argument, NULL, 1004},
+		{"skip", required_argument, NULL, 1005},
+		{"warm", required_argument, NULL, 1006},
+		{"measure", required_argument, NULL, 1007},
+		{"set-sample", required_argument, NULL, 1008},
+		{"parse-threads", required_argument, NULL, 1009},
+		{"malformed", required_argument, NULL, 1010},
+		{"split-accesses", no_argument, NULL, 1011},
+		{"protocol", required_argument, NULL, 1012},
+		{"cores", required_argument, NULL, 1013},
+		{"interconnect", required_argument, NULL, 1014},
+		{"false-sharing", required_argument, NULL, 1015},
+		{"tlb", required_argument, NULL, 1016},
+		{"page-size", required_argument, NULL, 1017},
+		{"page-walk", no_argument, NULL, 1018},
+		{"latency", required_argument, NULL, 1019},
+		{"mlp", required_argument, NULL, 1020},
+		{"dram", required_argument, NULL, 1021},
+		{"dram-map", required_argument, NULL, 1022},
+		{"dram-timing", required_argument, NULL, 1023},
+		{"dram-epoch", required_argument, NULL, 1024},
+		{"dram-bandwidth", required_argument, NULL, 1025},
+		{"dram-queue", required_argument, NULL, 1031},
+		{"sparse", no_argument, NULL, 1026},
+		{"no-huge-pages", no_argument, NULL, 1027},
+		{"numa-local", no_argument, NULL, 1028},
+		{"packed", no_argument, NULL, 1029},
+		{"sweep", required_argument, NULL, 1030},
+		{NULL, 0, NULL, 0}
+	};
 
 	// Parsing command line arguments
-	while ((c = getopt(argc, argv, "vhs:E:b:t:")) != -1) {
+	while ((c = getopt_long(argc, argv, "vhs:E:b:t:l:", long_options,
+					NULL)) != -1) {
 		switch (c) {
 			case 'v':
 				// enable verbose mode
@@ -114,10 +234,224 @@ int main(int argc, char *argv[]) {
 				b_flag = 1;
 				break;
 			case 't':
-				// specify the trace filename
+				// specify the trace filename, - for stdin
 				trace_filename = optarg;
 				t_flag = 1;
 				break;	
+			case 'l':
+				// write a binary record of every access to this file
+				event_log_filename = optarg;
+				break;
+			case 1000:
+				// report how fast the simulator itself ran
+				perfEnable(0);
+				break;
+			case 1001:
+				// same, plus hardware counters where the kernel allows
+				perfEnable(1);
+				break;
+			case 1002:
+				// save the whole cache state when the run ends
+				options.checkpoint_file = optarg;
+				break;
+			case 1003:
+				// fast-forward this many records, then stop
+				options.checkpoint_after = strtoul(optarg, NULL, 10);
+				break;
+			case 1004:
+				// resume from a saved cache state
+				options.restore_file = optarg;
+				break;
+			case 1005:
+				// records to parse past without simulating, per period
+				options.skip = strtoul(optarg, NULL, 10);
+				break;
+			case 1006:
+				// records that only warm the cache, per period
+				options.warm = strtoul(optarg, NULL, 10);
+				break;
+			case 1007:
+				// records that are counted, per period
+				options.measure = strtoul(optarg, NULL, 10);
+				break;
+			case 1008:
+				// simulate a hashed 1/n of the sets and scale the counts
+				options.set_sample = strtoul(optarg, NULL, 10);
+				if (options.set_sample == 0 || (options.set_sample
+							& (options.set_sample - 1))) {
+					printf("Error: --set-sample must be a power of two\n");
+					exit(1);
+				}
+				break;
+			case 1009:
+				// parse a plain trace file on this many threads
+				options.parse_threads = strtol(optarg, NULL, 10);
+				break;
+			case 1010:
+				// stop at the first malformed record, or skip past them
+				if (!strcmp(optarg, "strict")) {
+					options.skip_malformed = 0;
+				} else if (!strcmp(optarg, "skip")) {
+					options.skip_malformed = 1;
+				} else {
+					printf("Error: --malformed must be strict or skip\n");
+					exit(1);
+				}
+				break;
+			case 1011:
+				// count an access once for every block it touches
+				options.split_accesses = 1;
+				break;
+			case 1012:
+				// simulate one coherent private cache per core
+				if (!strcmp(optarg, "msi")) {
+					options.protocol = PROTOCOL_MSI;
+				} else if (!strcmp(optarg, "mesi")) {
+					options.protocol = PROTOCOL_MESI;
+				} else if (!strcmp(optarg, "moesi")) {
+					options.protocol = PROTOCOL_MOESI;
+				} else {
+					printf("Error: --protocol must be msi, mesi or moesi\n");
+					exit(1);
+				}
+				break;
+			case 1013:
+				// cores named by the thread column of a merged trace
+				options.cores = strtol(optarg, NULL, 10);
+				break;
+			case 1014:
+				// how coherence requests travel
+				if (!strcmp(optarg, "snoop")) {
+					options.interconnect = INTERCONNECT_SNOOP;
+				} else if (!strcmp(optarg, "directory")) {
+					options.interconnect = INTERCONNECT_DIRECTORY;
+				} else {
+					printf("Error: --interconnect must be snoop or"
+							" directory\n");
+					exit(1);
+				}
+				break;
+			case 1015:
+				// report the blocks most invalidated by disjoint writes
+				options.false_sharing = strtol(optarg, NULL, 10);
+				if (options.false_sharing < 1) {
+					printf("Error: --false-sharing needs a count\n");
+					exit(1);
+				}
+				break;
+			case 1016:
+				// translate through an L1 and optionally an L2 TLB
+				if (sscanf(optarg, "%d:%d,%d:%d", &options.tlb.l1_entries,
+							&options.tlb.l1_ways, &options.tlb.l2_entries,
+							&options.tlb.l2_ways) < 2) {
+					printf("Error: --tlb must be <entries>:<ways>"
+							"[,<entries>:<ways>]\n");
+					exit(1);
+				}
+				break;
+			case 1017:
+				// the one page size every address is mapped with
+				if (!strcmp(optarg, "4k")) {
+					options.tlb.page_bits = PAGE_BITS_4K;
+				} else if (!strcmp(optarg, "2m")) {
+					options.tlb.page_bits = PAGE_BITS_2M;
+				} else if (!strcmp(optarg, "1g")) {
+					options.tlb.page_bits = PAGE_BITS_1G;
+				} else {
+					printf("Error: --page-size must be 4k, 2m or 1g\n");
+					exit(1);
+				}
+				break;
+			case 1018:
+				// TLB misses load their page table entries through the cache
+				options.page_walk = 1;
+				break;
+			case 1019:
+				// cycles for a hit, a miss on top of it, memory and the TLB
+				if (sscanf(optarg, "%d:%d:%d:%d", &options.latency.hit,
+							&options.latency.miss_penalty,
+							&options.latency.memory,
+							&options.latency.tlb) < 3
+						|| options.latency.hit < 0
+						|| options.latency.miss_penalty < 0
+						|| options.latency.memory < 0
+						|| options.latency.tlb < 0) {
+					printf("Error: --latency must be <hit>:<miss-penalty>"
+							":<memory>[:<tlb>]\n");
+					exit(1);
+				}
+				options.model_latency = 1;
+				break;
+			case 1020:
+				// misses that may overlap each other
+				options.latency.mlp = strtol(optarg, NULL, 10);
+				if (options.latency.mlp < 1) {
+					printf("Error: --mlp needs a window of at least 1\n");
+					exit(1);
+				}
+				break;
+			case 1021:
+				// send misses and dirty evictions to a DRAM model
+				if (sscanf(optarg, "%d:%d:%d:%d", &options.dram.channels,
+							&options.dram.ranks, &options.dram.banks,
+							&options.dram.row_bytes) != 4) {
+					printf("Error: --dram must be <channels>:<ranks>:<banks>"
+							":<row-bytes>\n");
+					exit(1);
+				}
+				break;
+			case 1022:
+				// which address bits pick the channel, rank, bank and row
+				options.dram.map = optarg;
+				break;
+			case 1023:
+				// cycles to read an open row, open one, close one and burst
+				if (sscanf(optarg, "%d:%d:%d:%d", &options.dram.t_cas,
+							&options.dram.t_rcd, &options.dram.t_rp,
+							&options.dram.t_burst) != 4) {
+					printf("Error: --dram-timing must be <cas>:<rcd>:<rp>"
+							":<burst>\n");
+					exit(1);
+				}
+				break;
+			case 1024:
+				// cycles per bandwidth sample
+				options.dram.epoch = strtoul(optarg, NULL, 10);
+				break;
+			case 1025:
+				// write the bandwidth samples here
+				options.dram_bandwidth_file = optarg;
+				break;
+			case 1031:
+				// requests a channel holds before arrivals have to wait
+				options.dram.queue_depth = strtol(optarg, NULL, 10);
+				break;
+			case 1026:
+				// allocate sets as the trace touches them
+				options.sparse = 1;
+				break;
+			case 1027:
+				// keep the cache on ordinary pages
+				huge_pages = 0;
+				break;
+			case 1028:
+				// keep the cache on the node of the thread using it
+				numa_local = 1;
+				break;
+			case 1029:
+				// bitmasks, rank fields and tag offsets instead of lines
+				options.packed = 1;
+				break;
+			case 1030:
+				// small caches simulated in the same pass, for a sweep
+				options.sweep_count = parseSweep(optarg, &options.sweep);
+				if (options.sweep_count < 0) {
+					printf("Error: --sweep must be <s>:<E>:<b>"
+							"[,<s>:<E>:<b>...] with E at most %d\n",
+							LOCKSTEP_MAX_WAYS);
+					exit(1);
+				}
+				break;
 			default:
 				// default usage
 				usage(argv[0]);
@@ -140,9 +474,93 @@ int main(int argc, char *argv[]) {
 		printf("\n");
 	}
 
+	// Large caches go on huge pages unless told otherwise
+	cacheSetAllocation(huge_pages, numa_local);
+
+	// Events are produced for the text stream and/or the binary log
+	eventOpen(verbose_mode, event_log_filename);
+
 	// BEGIN SIMULATION!	
-	simulateCache(trace_filename, num_sets, block_size,
-		   	lines_per_set, verbose_mode);
+	if (options.false_sharing && options.protocol < 0) {
+		printf("Error: --false-sharing needs --protocol\n");
+		exit(1);
+	}
+	if (options.page_walk && options.tlb.l1_entries == 0) {
+		printf("Error: --page-walk needs --tlb\n");
+		exit(1);
+	}
+	if (options.latency.mlp && !options.model_latency) {
+		printf("Error: --mlp needs --latency\n");
+		exit(1);
+	}
+	if (options.model_latency && (options.protocol >= 0
+				|| options.set_sample > 1)) {
+		printf("Error: --latency can't be combined with --protocol or"
+				" --set-sample\n");
+		exit(1);
+	}
+	if (options.dram.channels && (options.protocol >= 0
+				|| options.set_sample > 1 || options.split_accesses)) {
+		printf("Error: --dram can't be combined with --protocol,"
+				" --set-sample or --split-accesses\n");
+		exit(1);
+	}
+	if (options.packed && (lines_per_set > PACKED_MAX_WAYS
+				|| options.dram.channels || options.protocol >= 0
+				|| options.checkpoint_file != NULL
+				|| options.restore_file != NULL)) {
+		printf("Error: --packed needs -E %d or less, and can't be combined"
+				" with --dram, --protocol or checkpoints\n", PACKED_MAX_WAYS);
+		exit(1);
+	}
+	if (options.tlb.l1_entries && (options.protocol >= 0
+				|| options.set_sample > 1)) {
+		printf("Error: --tlb can't be combined with --protocol or"
+				" --set-sample\n");
+		exit(1);
+	}
+	if (options.set_sample > 1 && (options.checkpoint_file != NULL
+				|| options.restore_file != NULL || verbose_mode
+				|| event_log_filename != NULL)) {
+		printf("Error: --set-sample can't be combined with -v, -l or"
+				" checkpoints\n");
+		exit(1);
+	}
+	if (options.sweep != NULL) {
+		if (lines_per_set > LOCKSTEP_MAX_WAYS || verbose_mode
+				|| event_log_filename != NULL
+				|| options.checkpoint_file != NULL
+				|| options.restore_file != NULL || options.skip
+				|| options.warm || options.measure || options.set_sample > 1
+				|| options.split_accesses || options.protocol >= 0
+				|| options.tlb.l1_entries || options.model_latency
+				|| options.dram.channels || options.sparse
+				|| options.packed) {
+			printf("Error: --sweep needs -E %d or less, and counts only;"
+					" it can't be combined with -v, -l, checkpoints,"
+					" sampling or the other models\n", LOCKSTEP_MAX_WAYS);
+			exit(1);
+		}
+		simulateSweep(trace_filename, num_sets, block_size, lines_per_set,
+				&options);
+		free(options.sweep);
+	} else if (options.protocol >= 0) {
+		if (event_log_filename != NULL || options.checkpoint_file != NULL
+				|| options.restore_file != NULL || options.skip
+				|| options.warm || options.measure || options.set_sample > 1
+				|| options.split_accesses || perf_enabled) {
+			printf("Error: --protocol can't be combined with -l, checkpoints,"
+					" sampling, --split-accesses or --stats-perf\n");
+			exit(1);
+		}
+		simulateMulticore(trace_filename, num_sets, block_size,
+				lines_per_set, verbose_mode, &options);
+	} else {
+		simulateCache(trace_filename, num_sets, block_size, lines_per_set,
+				verbose_mode || event_log_filename != NULL, &options);
+	}
+
+	eventClose();
 
     return 0;
 }
@@ -161,450 +579,1192 @@ int main(int argc, char *argv[]) {
  * @param num_sets Number of sets in the simulator.
  * @param block_size Number of bytes in each cache block.
  * @param lines_per_set Number of lines in each cache set.
- * @param verbose Whether to print out extra information about what the
- *   simulator is doing (1 = yes, 0 = no).
+ * @param verbose Whether to record an event for every access
+ *   (1 = yes, 0 = no).
+ * @param options Checkpointing, sampling and other optional behaviour.
+ *   With --skip, --warm or --measure the trace is processed in periods of
+ *   skip records that are only parsed past, warm records that update the
+ *   cache without being counted, then measure records that are simulated
+ *   in full. With --tlb every L, S and M is translated first, warming the
+ *   TLBs along with the cache, and with --page-walk a TLB miss loads its
+ *   page table entries through the cache ahead of the access. The TLBs
+ *   aren't checkpointed, so a restored run starts them empty. With
+ *   --latency the measured references are also turned into cycles; a
+ *   reference that needed a page walk depends on it. With --dram the
+ *   measured misses and dirty evictions are sent to a DRAM model. They
+ *   arrive at the latency model's clock, or else one reference per cycle.
+ *   Dirty bits aren't checkpointed, so a restored cache starts clean.
+ *   With --sparse, or SPARSE_SET_BITS or more set bits, sets are only
+ *   given lines when the trace first touches them. With --packed the
+ *   cache is kept in the compact encoding of packed.c instead. With
+ *   --set-sample only the sampled sets are simulated, in a cache of their
+ *   own, and the other accesses are just counted.
  */
 void simulateCache(char *trace_file, int num_sets, int block_size,
-						int lines_per_set, int verbose) {
+						int lines_per_set, int verbose,
+						const sim_options_t *options) {
 	// Variables to track how many hits, misses, and evictions we've had so
 	// far during simulation.
 	int hit_count = 0;
 	int miss_count = 0;
 	int eviction_count = 0;
-	int set, tag, size = 0; 
+	int size = 0;
 	char operation[1];
 	mem_addr address = 0;
+	unsigned long records = 0, malformed = 0;
+	unsigned long split = 0, split_blocks = 0;
+	unsigned long walk_accesses = 0, walk_misses = 0;
+	mem_addr walk[MAX_WALK_LEVELS];
+	int walked, hits_before = 0, misses_before = 0;
+	trace_record_t record;
+	trace_position_t where;
+	int i;
+
+	// Sampling state; without sampling options every record is measured
+	int sampling = options->skip || options->warm || options->measure;
+	enum sample_phase phase = PHASE_MEASURE;
+	unsigned long phase_left = options->measure;
+	unsigned long skipped = 0, warmed = 0, measured = 0;
+	int scratch_hits, scratch_misses, scratch_evictions;
+	if (sampling) {
+		phase = PHASE_SKIP;
+	}
 
-	// Initializes Cache
-	Set *cache = malloc(num_sets *  sizeof(Set));
+	// Set sampling: only the sampled sets are simulated, packed into a
+	// cache of their own, and the rest of the trace is only counted
+	set_sample_t sample = { 0, 0, NULL, 0, NULL, 0 };
+	int cache_sets = num_sets;
+	if (options->set_sample > 1) {
+		sample.mask = options->set_sample - 1;
+		for (i = 0; i < num_sets; i++) {
+			sample.count += (hashSet(i) & sample.mask) == 0;
+		}
+		if (sample.count == 0) {
+			printf("Error: --set-sample %u leaves none of the %d sets to"
+					" simulate\n", options->set_sample, num_sets);
+			exit(1);
+		}
+		while ((1U << sample.slot_bits) < sample.count) {
+			sample.slot_bits++;
+		}
+		sample.sets = malloc(sample.count * sizeof(unsigned int));
+		sample.misses = calloc(sample.count, sizeof(unsigned int));
+		if (sample.sets == NULL || sample.misses == NULL) {
+			printf("Error allocating set sample counters\n");
+			exit(1);
+		}
+		sample.count = 0;
+		for (i = 0; i < num_sets; i++) {
+			if ((hashSet(i) & sample.mask) == 0) {
+				sample.sets[sample.count++] = i;
+			}
+		}
+		cache_sets = 1 << sample.slot_bits;
+	}
 
-	// Iniitializes Cache inards
-	int i, j;
-	for (i = 0; i < num_sets; i++){
-		cache[i].Lines = malloc(lines_per_set *  sizeof(Line));
-		for (j = 0; j < lines_per_set; j++){
-			cache[i].Lines[j].valid = 0;
-			cache[i].Lines[j].lru = j;
-			cache[i].Lines[j].tag = 0;
+	// TLBs in front of the cache
+	tlb_t *tlb = NULL;
+	if (options->tlb.l1_entries > 0) {
+		tlb = tlbCreate(&options->tlb);
+		if (tlb == NULL) {
+			printf("Error: TLB entries and ways must be powers of two\n");
+			exit(1);
 		}
 	}
 
-	// Seeing if valid file and opening it
-	FILE *fp = fopen(trace_file, "r");
+	// Cycles, when asked for; plain counting never touches the model
+	latency_t *lat = NULL;
+	if (options->model_latency) {
+		lat = latencyCreate(&options->latency);
+	}
+
+	// Memory behind the cache, which needs to know which lines are dirty
+	dram_t *dram = NULL;
+	unsigned char *dirty = NULL;
+	if (options->dram.channels > 0) {
+		dram_config_t dram_config = options->dram;
+		dram_config.block_bits = (int)log2(block_size);
+		dram = dramCreate(&dram_config);
+		if (dram == NULL) {
+			printf("Error: DRAM sizes must be powers of two, the row at"
+					" least a block, the queue at least 1 deep, and the map"
+					" a permutation of Ro, Ra, Ba, Ch and Co starting with"
+					" Ro\n");
+			exit(1);
+		}
+		dirty = calloc((size_t)num_sets * lines_per_set, 1);
+		if (dirty == NULL) {
+			printf("Error allocating dirty bits\n");
+			exit(1);
+		}
+	}
+	unsigned long long arrival = 0;
+
+	// A plain run hands its accesses to the cache model a buffer at a
+	// time; the other models need each one simulated as it is read
+	int batched = !sampling && !sample.mask && tlb == NULL && lat == NULL
+		&& dram == NULL && !options->split_accesses;
+	trace_record_t batch[SERIAL_BATCH_SIZE];
+	size_t buffered = 0;
+
+	// Initializes Cache, warm from a checkpoint if asked to
+	Set *cache;
+	checkpoint_t saved = { (int)log2(num_sets), lines_per_set,
+		(int)log2(block_size), 0, 0, 0, 0, 0 };
+	if (options->restore_file != NULL) {
+		cache = restoreCheckpoint(options->restore_file, &saved);
+		if (cache == NULL) {
+			printf("Error reading checkpoint\n");
+			exit(1);
+		}
+		if (saved.set_bits != (int)log2(num_sets)
+				|| saved.lines_per_set != lines_per_set
+				|| saved.block_bits != (int)log2(block_size)) {
+			printf("Error: checkpoint is for -s %d -E %d -b %d\n",
+					saved.set_bits, saved.lines_per_set, saved.block_bits);
+			exit(1);
+		}
+		hit_count = saved.hits;
+		miss_count = saved.misses;
+		eviction_count = saved.evictions;
+	} else if (options->packed) {
+		cache = createPackedCache(cache_sets, lines_per_set);
+	} else if (cache_sets > 1 && (options->sparse
+				|| cache_sets >= 1 << SPARSE_SET_BITS)) {
+		cache = createSparseCache(cache_sets, lines_per_set);
+	} else {
+		cache = createCache(cache_sets, lines_per_set);
+	}
+
+	// A single set is fully associative, which has its own O(1) engine
+	if (cache == NULL || (cache_sets == 1 && !options->packed
+				&& cacheIndex(cache, lines_per_set))) {
+		printf("Error allocating cache\n");
+		exit(1);
+	}
+
+	// Seeing if valid file and opening it. Traces may be streamed from
+	// stdin or a named pipe, or be compressed, so they are only ever read
+	// forwards unless they are plain files.
+	int seekable;
+	enum trace_format format;
+	FILE *fp = openTrace(trace_file, &seekable, &format);
 	if (fp == NULL) {
-		printf("Error opening file");
+		if (format != TRACE_PLAIN) {
+			printf("Error: no support for this compressed trace format\n");
+		} else {
+			printf("Error opening file");
+		}
 		exit(1);	
 	}
 
-	// Kickstart loop & parsing file
-	int ret = fscanf(fp, "%s %lx,%d", operation, &address, &size);
-	
-	while (ret == 3 && ret != EOF) {
+	// Resuming where the checkpoint left off. A stream can't seek, so it
+	// is fast-forwarded by the number of records already simulated, as is
+	// a file that is parsed in parallel.
+	int resumed = 0;
+	if (saved.records > 0 && seekable && saved.trace_offset > 0
+			&& options->parse_threads <= 1
+			&& !fseek(fp, saved.trace_offset, SEEK_SET)) {
+		resumed = 1;
+	}
+
+	// A plain file can be parsed ahead in parallel chunks; if it can't be
+	// mapped it is read from fp as usual
+	trace_reader_t *reader = readerOpen(fp, seekable && format == TRACE_PLAIN
+			? trace_file : NULL, options->parse_threads,
+			resumed ? saved.trace_offset : 0);
+	if (saved.records > 0 && !resumed
+			&& readerSkip(reader, saved.records) != saved.records) {
+		printf("Error: trace ends before the checkpoint\n");
+		exit(1);
+	}
+
+	// Measuring from the first record, after the cache is set up and any
+	// checkpoint restored
+	if (perf_enabled) {
+		perfStart();
+	}
 
-		// Isolating tag and set numbers
-		tag = address >> ((int)log2(block_size) + (int)log2(num_sets));
-		set = (address << (64 - ((int)log2(block_size) + (int)log2(num_sets))))
-				>> (64 - (int)log2(num_sets));
+	// Kickstart loop & parsing file; a skip that reaches the end of a
+	// fast-forward leaves nothing to read
+	if (phase == PHASE_SKIP) {
+		skipped = readerSkip(reader, clampSkip(options->skip, records,
+					options));
+		records = skipped;
+		phase = PHASE_WARM;
+		phase_left = options->warm;
+	}
+	enum parse_result ret = PARSE_END;
+	if (options->checkpoint_after == 0
+			|| records < options->checkpoint_after) {
+		PERF_BEGIN_RECORD();
+		ret = readerNext(reader, &record, &where);
+		PERF_MARK(PERF_PARSE);
+	}
+
+	// A plain run only hands its accesses to the cache model, a buffer at
+	// a time, so it has a loop of its own without the other models' work.
+	// A record --stats-perf times is simulated on its own, after the
+	// buffered ones, so its phases are its own.
+	while (batched && ret != PARSE_END) {
+		records++;
+		PERF_MARK(PERF_DECODE);
+		if (ret == PARSE_MALFORMED) {
+			flushBatch(cache, (int)log2(num_sets), (int)log2(block_size),
+					lines_per_set, batch, &buffered, verbose, &hit_count,
+					&miss_count, &eviction_count);
+			handleMalformed(&where, options, &malformed);
+		} else if (record.operation == 'L' || record.operation == 'S'
+				|| record.operation == 'M') {
+			batch[buffered++] = record;
+			if (buffered == SERIAL_BATCH_SIZE || perf_sample) {
+				flushBatch(cache, (int)log2(num_sets), (int)log2(block_size),
+						lines_per_set, batch, &buffered, verbose, &hit_count,
+						&miss_count, &eviction_count);
+			}
+		}
+		if (options->checkpoint_after != 0
+				&& records >= options->checkpoint_after) {
+			break;
+		}
+		if (buffered > 0 && perfNextSampled()) {
+			flushBatch(cache, (int)log2(num_sets), (int)log2(block_size),
+					lines_per_set, batch, &buffered, verbose, &hit_count,
+					&miss_count, &eviction_count);
+		}
+		PERF_BEGIN_RECORD();
+		ret = readerNext(reader, &record, &where);
+		PERF_MARK(PERF_PARSE);
+	}
+	flushBatch(cache, (int)log2(num_sets), (int)log2(block_size),
+			lines_per_set, batch, &buffered, verbose, &hit_count, &miss_count,
+			&eviction_count);
+
+	// Every other run simulates each record as it is read
+	while (!batched && ret != PARSE_END) {
+		records++;
+		operation[0] = record.operation;
+		address = record.address;
+		size = record.size;
+
+		// Skipping empty phases of the sampling period
+		if (phase == PHASE_WARM && phase_left == 0) {
+			phase = PHASE_MEASURE;
+			phase_left = options->measure;
+		}
+
+		// The cache model decodes the set and tag itself
+		PERF_MARK(PERF_DECODE);
+
+		// Translating first; a walk's loads reach the cache before the
+		// access does, and are counted and shown only when it would be
+		walked = 0;
+		if (dram != NULL) {
+			arrival = lat != NULL ? latencyNow(lat)
+				: (unsigned long long)hit_count + miss_count;
+		}
+		if (tlb != NULL && ret != PARSE_MALFORMED && (operation[0] == 'L'
+					|| operation[0] == 'S' || operation[0] == 'M')) {
+			int counted = phase == PHASE_MEASURE;
+			unsigned long l1_misses = tlbStats(tlb)->l1_misses;
+			int levels = tlbTranslate(tlb, address, counted, walk);
+			if (lat != NULL && tlbStats(tlb)->l1_misses != l1_misses) {
+				latencyStall(lat, options->latency.tlb);
+			}
+			if (lat != NULL && counted && !options->page_walk) {
+				latencyStall(lat, levels * options->latency.memory);
+			}
+			walked = levels > 0;
+			for (i = 0; options->page_walk && i < levels; i++) {
+				enum access_outcome outcome = backedOperation(cache, dirty,
+						counted ? dram : NULL, arrival, (int)log2(num_sets),
+						(int)log2(block_size), lines_per_set, 'L', walk[i], 8,
+						counted && verbose,
+						counted ? &hit_count : &scratch_hits,
+						counted ? &miss_count : &scratch_misses,
+						counted ? &eviction_count : &scratch_evictions);
+				if (counted) {
+					walk_accesses++;
+					walk_misses += outcome != ACCESS_HIT;
+				}
+				if (lat != NULL && counted) {
+					latencyAccess(lat, outcome == ACCESS_HIT, 1);
+				}
+			}
+		}
+		if (lat != NULL) {
+			hits_before = hit_count;
+			misses_before = miss_count;
+		}
 		
-		// Cases for each instruction
-		if (!strncmp(operation, "L", 1)){
-			operationL (cache, lines_per_set, address, size, verbose,
-				   	set, tag, &hit_count, &miss_count, &eviction_count);	
-		} 
-		else if (!strncmp(operation, "S", 1)) {
-			operationS (cache, lines_per_set, address, size, verbose,
-				   	set, tag, &hit_count, &miss_count, &eviction_count);	
+		// Bad lines stop the run, or are reported and passed over
+		if (ret == PARSE_MALFORMED) {
+			handleMalformed(&where, options, &malformed);
+		}
+
+		// Set sampling: every access is counted, and each block it touches
+		// simulated if its set is in the sample
+		else if (sample.mask) {
+			if (operation[0] == 'L' || operation[0] == 'S'
+					|| operation[0] == 'M') {
+				int counted = phase == PHASE_MEASURE;
+				int blocks = sampleAccess(cache, &sample, (int)log2(num_sets),
+						(int)log2(block_size), lines_per_set, operation[0],
+						address, size, options->split_accesses, counted,
+						counted ? &hit_count : &scratch_hits,
+						counted ? &miss_count : &scratch_misses,
+						counted ? &eviction_count : &scratch_evictions);
+				if (counted && blocks > 1) {
+					split++;
+					split_blocks += blocks;
+				}
+			}
+			if (phase == PHASE_WARM) {
+				warmed++;
+			}
+		}
+
+		// Functional warming: tags and LRU only, nothing counted or shown
+		else if (phase == PHASE_WARM) {
+			if (options->split_accesses && (operation[0] == 'L'
+						|| operation[0] == 'S' || operation[0] == 'M')) {
+				cacheAccessSplit(cache, (int)log2(num_sets),
+						(int)log2(block_size), lines_per_set, operation[0],
+						address, size, 0, &scratch_hits, &scratch_misses,
+						&scratch_evictions);
+			} else if (operation[0] == 'L' || operation[0] == 'S'
+					|| operation[0] == 'M') {
+				backedOperation(cache, dirty, NULL, 0, (int)log2(num_sets),
+						(int)log2(block_size), lines_per_set, operation[0],
+						address, size, 0, &scratch_hits, &scratch_misses,
+						&scratch_evictions);
+			}
+			warmed++;
+		}
+
+		// Accesses split at block boundaries, each piece simulated and shown
+		else if (options->split_accesses && (operation[0] == 'L'
+					|| operation[0] == 'S' || operation[0] == 'M')) {
+			int blocks = cacheAccessSplit(cache, (int)log2(num_sets),
+					(int)log2(block_size), lines_per_set, operation[0],
+					address, size, verbose, &hit_count, &miss_count,
+					&eviction_count);
+			if (blocks > 1) {
+				split++;
+				split_blocks += blocks;
+			}
+		}
+
+		// Loads, stores and modifies all go through the same lookup
+		else if (operation[0] == 'L' || operation[0] == 'S'
+				|| operation[0] == 'M') {
+			backedOperation(cache, dirty, dram, arrival, (int)log2(num_sets),
+					(int)log2(block_size), lines_per_set, operation[0],
+					address, size, verbose, &hit_count, &miss_count,
+					&eviction_count);
 		}
-		else if(!strncmp(operation, "M", 1)) {
-			operationM (cache, lines_per_set, address, size, verbose,
-				   	set, tag, &hit_count, &miss_count, &eviction_count);	
-		} 
 		else if(!strncmp(operation, "I", 1)) {
 			;	
 		} 
-		else {
-			printf("Error \n");
+
+		// Each hit and miss of a measured access costs its cycles
+		if (lat != NULL && phase == PHASE_MEASURE) {
+			for (i = misses_before; i < miss_count; i++) {
+				latencyAccess(lat, 0, walked);
+			}
+			for (i = hits_before; i < hit_count; i++) {
+				latencyAccess(lat, 1, walked);
+			}
+		}
+
+		// Advancing the sampling period
+		if (sampling) {
+			if (phase == PHASE_MEASURE) {
+				measured++;
+			}
+			if (phase_left != 0 && --phase_left == 0) {
+				if (phase == PHASE_WARM) {
+					phase = PHASE_MEASURE;
+					phase_left = options->measure;
+				} else {
+					unsigned long n = readerSkip(reader,
+							clampSkip(options->skip, records, options));
+					skipped += n;
+					records += n;
+					phase = PHASE_WARM;
+					phase_left = options->warm;
+				}
+			}
+		}
+
+		// Fast-forward finished, leave the rest for a resumed run. Skips
+		// are clamped, so they stop exactly at the checkpoint too.
+		if (options->checkpoint_after != 0
+				&& records >= options->checkpoint_after) {
+			break;
 		}
 
 		// Grabbing next line of input
-		ret = fscanf(fp, "%s %lx,%d", operation, &address, &size); 
+		PERF_BEGIN_RECORD();
+		ret = readerNext(reader, &record, &where);
+		PERF_MARK(PERF_PARSE);
 	}
 
-	// Freeing cache
-	for (i = 0; i < num_sets; i++){
-		free(cache[i].Lines);
+	// A compressed trace that is truncated or corrupt fails here
+	if (ferror(fp)) {
+		traceReadError(trace_file, format);
 	}
-	free(cache);
 
-	// Printing stats
+	if (perf_enabled) {
+		perfStop(records);
+	}
+
+	if (options->checkpoint_file != NULL) {
+		saved.hits = hit_count;
+		saved.misses = miss_count;
+		saved.evictions = eviction_count;
+		saved.records += records;
+		saved.trace_offset = seekable ? readerOffset(reader) : -1;
+		if (saveCheckpoint(options->checkpoint_file, cache, &saved)) {
+			printf("Error writing checkpoint\n");
+			exit(1);
+		}
+	}
+
+	// Freeing cache, after noting how much of a sparse one was used and
+	// what a large one was stored in
+	unsigned long touched_sets = 0;
+	size_t touched_bytes = 0;
+	cache_arena_t arena = *cacheArena(cache);
+	if (arena.sparse) {
+		touched_bytes = arena.size;
+		touched_sets = touched_bytes / (lines_per_set * sizeof(Line));
+	}
+	freeCache(cache, cache_sets);
+
+	// Printing stats after any buffered events
+	eventFlush();
+	if (sampling) {
+		printf("Sampled: measured %lu, warmed %lu, skipped %lu records\n",
+				measured, warmed, skipped);
+	}
+	if (malformed > 0) {
+		printf("Skipped %lu malformed records\n", malformed);
+	}
+	if (options->split_accesses) {
+		printf("Split: %lu accesses crossed a block boundary, touching %lu"
+				" blocks\n", split, split_blocks);
+	}
+	if (arena.packed != NULL) {
+		printf("Cache state: %lu KiB packed\n",
+				(unsigned long)(arena.size >> 10));
+	} else if (!arena.sparse && (arena.size >= HUGE_PAGE_SIZE
+				|| arena.numa_local)) {
+		printf("Cache arena: %lu KiB on %s%s\n",
+				(unsigned long)(arena.size >> 10),
+				cacheBackingName(arena.backing),
+				arena.numa_local ? ", NUMA local" : "");
+	}
+	if (touched_sets > 0) {
+		printf("Sparse: touched %lu of %d sets, %lu KiB of lines\n",
+				touched_sets, cache_sets, (unsigned long)(touched_bytes >> 10));
+	}
+	if (tlb != NULL) {
+		const tlb_stats_t *tlb_stats = tlbStats(tlb);
+		printf("TLB: accesses:%lu l1-misses:%lu walks:%lu\n",
+				tlb_stats->accesses, tlb_stats->l1_misses,
+				tlb_stats->l2_misses);
+		if (options->page_walk) {
+			printf("Page walks: cache accesses:%lu misses:%lu\n",
+					walk_accesses, walk_misses);
+		}
+		tlbFree(tlb);
+	}
+	if (lat != NULL) {
+		latencyReport(lat);
+		latencyFree(lat);
+	}
+	if (dram != NULL) {
+		FILE *out = NULL;
+		if (options->dram_bandwidth_file != NULL) {
+			out = fopen(options->dram_bandwidth_file, "w");
+			if (out == NULL) {
+				printf("Error opening %s\n", options->dram_bandwidth_file);
+				exit(1);
+			}
+		}
+		dramReport(dram, out);
+		if (out != NULL) {
+			fclose(out);
+		}
+		dramFree(dram);
+		free(dirty);
+	}
 	printf("\n");
-	printSummary(hit_count, miss_count, eviction_count);
+	if (sample.mask) {
+		printSetSampleSummary(miss_count, eviction_count, num_sets, &sample);
+		free(sample.sets);
+		free(sample.misses);
+	} else {
+		printSummary(hit_count, miss_count, eviction_count);
+	}
+	if (perf_enabled) {
+		perfReport();
+	}
 
-	fclose(fp);
+	readerClose(reader);
+	closeTrace(fp);
 }
 
 
 
 /**
- * Simulates the process of the L instruction in a cache. 
- *
+ * Simulates one access like cacheOperation, keeping a dirty bit per line.
+ * A miss reads its block from memory after any dirty line it evicts has
+ * been written back.
  *
  * @param cache An array of type Set that simulates a cache
+ * @param dirty One flag per line, or NULL to call cacheOperation alone
+ * @param dram Memory behind the cache, or NULL to only track dirty lines
+ * @param arrival Cycle the access's requests reach memory
+ * @param set_bits Number of set index bits
+ * @param block_bits Number of block offset bits
  * @param lines_per_set Number of lines per cache set
- * @param address The memory location of the memory access
- * @param size Number of bytes in each cache block
- * @param verbose A flag which is set for verbose mode
- * @param set The set number of the memory access
- * @param tag The tag of the data memory access
+ * @param operation 'L', 'S' or 'M'
+ * @param address Memory location of the access
+ * @param size Number of bytes accessed
+ * @param verbose A flag which is set when events are recorded
  * @param hit_count A counter of cache hits
  * @param miss_count A counter of cache misses
  * @param eviction_count A counter of cache evictions
+ * @return What the access did
  */
-void operationL (Set *cache, int lines_per_set, mem_addr address, int size,
-	   	int verbose, int set, int tag, int *hit_count, int *miss_count,
-	   	int *eviction_count) {
-	int found = 0;
-	int i;
-	
-	// Checking if hit
-	for (i = 0; i < lines_per_set; i++) {
-		if (cache[set].Lines[i].valid == 1) {
-			if (cache[set].Lines[i].tag == tag){
-				hit(cache, lines_per_set, address, i, 'L', size, verbose, set,
-					   	tag, hit_count, &found);
-				break;	
-			}
-		}
+enum access_outcome backedOperation(Set *cache, unsigned char *dirty,
+		dram_t *dram, unsigned long long arrival, int set_bits,
+		int block_bits, int lines_per_set, char operation, mem_addr address,
+		int size, int verbose, int *hit_count, int *miss_count,
+		int *eviction_count) {
+	int set = (int)((address >> block_bits) & ((1UL << set_bits) - 1));
+	int way = -1;
+	Line *line;
+
+	if (dirty != NULL) {
+		way = cacheLookup(cache, lines_per_set, set,
+				address >> (block_bits + set_bits));
 	}
 
-	// Checking valid bits for miss
-	if (!found) {
-		for (i = 0; i < lines_per_set; i++) {
-			if (cache[set].Lines[i].valid == 0) {
-				miss(cache, lines_per_set, address, i, 'L', size, verbose, set,
-					   	tag, hit_count, miss_count, &found);
-				break;
-			}
-		}	
+	// Writing back the victim and reading the block
+	if (dirty != NULL && way < 0) {
+		way = cacheVictim(cache, lines_per_set, set);
+		if (way < 0) {
+			printf("Error allocating cache\n");
+			exit(1);
+		}
+		line = &cache[set].Lines[way];
+		if (line->valid && dirty[(size_t)set * lines_per_set + way]
+				&& dram != NULL) {
+			dramRequest(dram, ((mem_addr)line->tag << (block_bits + set_bits))
+					| ((mem_addr)set << block_bits), 1, arrival);
+		}
+		dirty[(size_t)set * lines_per_set + way] = 0;
+		if (dram != NULL) {
+			dramRequest(dram, address, 0, arrival);
+		}
 	}
 
-	// Checking for full cache for eviction
-	if (!found) {
-		for (i = 0; i < lines_per_set; i++) {
-			if (cache[set].Lines[i].lru == lines_per_set - 1) {
-				eviction(cache, lines_per_set, address, i, 'L', size, verbose,
-					   	set, tag, hit_count, miss_count, eviction_count,
-					   	&found);
-				break;
-			}
-		}
+	enum access_outcome outcome = cacheOperation(cache, set_bits, block_bits,
+			lines_per_set, operation, address, size, verbose, hit_count,
+			miss_count, eviction_count);
+	if (dirty != NULL && operation != 'L') {
+		dirty[(size_t)set * lines_per_set + way] = 1;
 	}
+	return outcome;
 }
 
 
 
 /**
- * Simulates the process of the S instruction in a cache. 
+ * Simulates the cache given by -s, -E and -b together with every cache of
+ * --sweep in a single pass over the trace. The caches are stepped through
+ * each buffer of records LOCKSTEP_LANES at a time by lockstep.c, and each
+ * is counted exactly as a run of its own would be. Caches are grouped by
+ * lines per set, so a group searches no more ways than its caches need.
+ * The swept caches are reported one per line, in the order given, ahead of the
+ * usual summary of the first.
  *
- *
- * @param cache An array of type Set that simulates a cache
- * @param lines_per_set Number of lines per cache set
- * @param address Memory location of the memory access
- * @param size Number of bytes in each cache block
- * @param verbose A flag which is set if the user wants verbose mode
- * @param set The set number of the memory access
- * @param tag The tag of the memory access
- * @param hit_count A counter of cache hits
- * @param miss_count A counter of cache misses
- * @param eviction_count A counter of cache evictions
+ * @param trace_file Name of the file with the memory addresses.
+ * @param num_sets Number of sets in the first cache.
+ * @param block_size Number of bytes in each block of the first cache.
+ * @param lines_per_set Number of lines in each set of the first cache.
+ * @param options The swept caches, and how to parse the trace.
  */
-void operationS (Set *cache, int lines_per_set, mem_addr address, int size,
-	   	int verbose, int set, int tag, int *hit_count, int *miss_count,
-	   	int *eviction_count) {
-	int found = 0;
-	int i;
-
-	//Checking for hit
-	for (i = 0; i < lines_per_set; i++) {
-		if (cache[set].Lines[i].valid == 1) {
-			if (cache[set].Lines[i].tag == tag) {
-				hit(cache, lines_per_set, address, i, 'S', size, verbose, set,
-					   	tag, hit_count, &found);	
-				break;	
+void simulateSweep(char *trace_file, int num_sets, int block_size,
+		int lines_per_set, const sim_options_t *options) {
+	int caches = options->sweep_count + 1;
+	lockstep_config_t *configs = malloc(caches * sizeof(lockstep_config_t));
+	lockstep_config_t *grouped = malloc(caches * sizeof(lockstep_config_t));
+	lockstep_t **lanes = malloc(caches * sizeof(lockstep_t *));
+	int *order = malloc(caches * sizeof(int));
+	int *group_of = malloc(caches * sizeof(int));
+	int *lane_of = malloc(caches * sizeof(int));
+	trace_record_t batch[SWEEP_BATCH_SIZE];
+	trace_record_t record;
+	trace_position_t where;
+	unsigned long records = 0, malformed = 0;
+	size_t buffered = 0;
+	int groups = 0, c, g, i, j, ways;
+
+	if (configs == NULL || grouped == NULL || lanes == NULL || order == NULL
+			|| group_of == NULL || lane_of == NULL) {
+		printf("Error allocating swept caches\n");
+		exit(1);
+	}
+	configs[0].set_bits = (int)log2(num_sets);
+	configs[0].lines_per_set = lines_per_set;
+	configs[0].block_bits = (int)log2(block_size);
+	memcpy(configs + 1, options->sweep,
+			options->sweep_count * sizeof(lockstep_config_t));
+
+	// A group searches as many ways as its widest cache has, for every
+	// lane, and costs nearly as much with one lane as with all of them.
+	// Taking the caches widest first, LOCKSTEP_LANES at a time, gives the
+	// fewest groups, each as narrow as it can be, and leaves any part full
+	// group to the narrowest caches.
+	for (ways = LOCKSTEP_MAX_WAYS, i = 0; ways >= 1; ways--) {
+		for (c = 0; c < caches; c++) {
+			if (configs[c].lines_per_set == ways) {
+				order[i++] = c;
 			}
 		}
 	}
+	for (i = 0; i < caches; i = j) {
+		for (j = i; j < caches && j - i < LOCKSTEP_LANES; j++) {
+			grouped[j - i] = configs[order[j]];
+			group_of[order[j]] = groups;
+			lane_of[order[j]] = j - i;
+		}
+		lanes[groups] = lockstepCreate(grouped, j - i);
+		if (lanes[groups] == NULL) {
+			printf("Error: a swept cache needs fewer than 64 set and block"
+					" bits\n");
+			exit(1);
+		}
+		groups++;
+	}
 
-	// Checking valid bits for miss
-	if (!found) {
-		for (i = 0; i < lines_per_set; i++) {
-			if (cache[set].Lines[i].valid == 0) {
-				miss(cache, lines_per_set, address, i, 'S', size, verbose, set,
-					   	tag, hit_count, miss_count, &found);
-				break;
-			}
+	// Opening the trace as simulateCache does; it is read once for all
+	int seekable;
+	enum trace_format format;
+	FILE *fp = openTrace(trace_file, &seekable, &format);
+	if (fp == NULL) {
+		if (format != TRACE_PLAIN) {
+			printf("Error: no support for this compressed trace format\n");
+		} else {
+			printf("Error opening file");
 		}
-				
+		exit(1);
 	}
-	
-	// Checking for full cache for eviction 
-	if (!found){
-		for (i = 0; i < lines_per_set; i++) {
-			if (cache[set].Lines[i].lru == lines_per_set - 1) {
-				eviction(cache, lines_per_set, address, i, 'S', size, verbose,
-					   	set, tag, hit_count, miss_count, eviction_count,
-					   	&found);
-				break;
+	trace_reader_t *reader = readerOpen(fp, seekable && format == TRACE_PLAIN
+			? trace_file : NULL, options->parse_threads, 0);
+
+	// Measuring from the first record, after the caches are set up
+	if (perf_enabled) {
+		perfStart();
+	}
+
+	// Every group of caches takes each full buffer in turn
+	enum parse_result ret = readerNext(reader, &record, &where);
+	while (ret != PARSE_END) {
+		records++;
+		if (ret == PARSE_MALFORMED) {
+			handleMalformed(&where, options, &malformed);
+		} else {
+			batch[buffered++] = record;
+		}
+		ret = readerNext(reader, &record, &where);
+		if (buffered == SWEEP_BATCH_SIZE
+				|| (ret == PARSE_END && buffered > 0)) {
+			for (g = 0; g < groups; g++) {
+				lockstepAccessBatch(lanes[g], batch, buffered);
 			}
+			buffered = 0;
 		}
 	}
+
+	// A compressed trace that is truncated or corrupt fails here
+	if (ferror(fp)) {
+		traceReadError(trace_file, format);
+	}
+
+	if (perf_enabled) {
+		perfStop(records);
+	}
+
+	// Printing stats, the first cache last in the usual form
+	int hit_count, miss_count, eviction_count;
+	if (malformed > 0) {
+		printf("Skipped %lu malformed records\n", malformed);
+	}
+	for (c = 1; c < caches; c++) {
+		lockstepCounts(lanes[group_of[c]], lane_of[c], &hit_count,
+				&miss_count, &eviction_count);
+		printf("Sweep s:%d E:%d b:%d hits:%d misses:%d evictions:%d\n",
+				configs[c].set_bits, configs[c].lines_per_set,
+				configs[c].block_bits, hit_count, miss_count,
+				eviction_count);
+	}
+	lockstepCounts(lanes[group_of[0]], lane_of[0], &hit_count, &miss_count,
+			&eviction_count);
+	printf("\n");
+	printSummary(hit_count, miss_count, eviction_count);
+	if (perf_enabled) {
+		perfReport();
+	}
+
+	for (g = 0; g < groups; g++) {
+		lockstepFree(lanes[g]);
+	}
+	free(lanes);
+	free(configs);
+	free(grouped);
+	free(order);
+	free(group_of);
+	free(lane_of);
+	readerClose(reader);
+	closeTrace(fp);
 }
 
 
 
 /**
- * Simulates the process of the M instruction in a cache. 
- *
+ * Parses the caches of --sweep.
  *
- * @param cache An array of type Set that simulates a cache
- * @param lines_per_set Number of lines per cache set
- * @param address Memory location of the memory access
- * @param size Number of bytes in each cache block
- * @param verbose A flag which is set for verbose mode
- * @param set The set number of the memory address
- * @param tag The tag of the memory address
- * @param hit_count A counter of cache hits
- * @param miss_count A counter of cache misses
- * @param eviction_count A counter of cache evictions
+ * @param list Caches as <s>:<E>:<b>, separated by commas
+ * @param configs Receives a new array of the caches
+ * @return Number of caches, or -1 for a bad list
  */
-void operationM (Set *cache, int lines_per_set, mem_addr address, int size,
-	   	int verbose, int set, int tag, int *hit_count, int *miss_count,
-	   	int *eviction_count) {
-	int found = 0;
-	int i;
-	
-	// Checking for hit
-	for (i = 0; i < lines_per_set; i++) {
-		if (cache[set].Lines[i].valid == 1) {
-			if (cache[set].Lines[i].tag == tag) {
-				hit(cache, lines_per_set, address, i, 'M', size, verbose, set,
-					   	tag, hit_count, &found);
-				break;	
-			}
-		}
-	}
+int parseSweep(char *list, lockstep_config_t **configs) {
+	int count = 1, parsed = 0, used;
+	char *p;
 
-	// Checking valid bits for miss
-	if (!found) {
-		for (i = 0; i < lines_per_set; i++) {
-			if (cache[set].Lines[i].valid == 0) {
-				miss(cache, lines_per_set, address, i, 'M', size, verbose, set,
-					   	tag, hit_count, miss_count, &found);
-				break;
-			}
-		}		
+	for (p = list; *p != '\0'; p++) {
+		count += *p == ',';
+	}
+	*configs = malloc(count * sizeof(lockstep_config_t));
+	if (*configs == NULL) {
+		printf("Error allocating swept caches\n");
+		exit(1);
 	}
 
-	// Checking for full cache for eviction 
-	if (!found) {
-		for (i = 0; i < lines_per_set; i++) {
-			if (cache[set].Lines[i].lru == lines_per_set - 1) {
-				eviction(cache, lines_per_set, address, i, 'M', size, verbose,
-					   	set, tag, hit_count, miss_count, eviction_count,
-					   	&found);
-				break;
-					}
-				}
-			}	
+	for (p = list; ; p += used + 1) {
+		lockstep_config_t *config = &(*configs)[parsed];
+		used = 0;
+		if (sscanf(p, "%d:%d:%d%n", &config->set_bits,
+					&config->lines_per_set, &config->block_bits, &used) < 3
+				|| (p[used] != ',' && p[used] != '\0')
+				|| config->set_bits < 0 || config->block_bits < 0
+				|| config->lines_per_set < 1
+				|| config->lines_per_set > LOCKSTEP_MAX_WAYS) {
+			free(*configs);
+			*configs = NULL;
+			return -1;
+		}
+		parsed++;
+		if (p[used] == '\0') {
+			return parsed;
+		}
+	}
 }
 
 
 
 /**
- * Simulation of a cache hit.
- *
+ * Simulates one coherent private cache per core. Each core has its own
+ * trace, given as a comma separated list, or the cores share one trace
+ * whose records end in the thread that made them. Separate traces are
+ * interleaved one record at a time.
  *
- * @param cache An array of type Set that simulates a cache
- * @param lines_per_set Number of lines per cache set
- * @param address Memory location of the memory access
- * @param i Line number in the set
- * @param operation The performed operation
- * @param size Number of block bytes in each cache block 
- * @param verbose A flag which is set for verbose mode
- * @param set The set number of the memory address
- * @param tag The tag of the memory address
- * @param hit_count A counter of cache hits
- * @param found The flag which tracks if the address was found
+ * @param trace_files One trace, or one per core separated by commas
+ * @param num_sets Number of sets in each cache
+ * @param block_size Number of bytes in each cache block
+ * @param lines_per_set Number of lines in each cache set
+ * @param verbose Whether to print every access (1 = yes, 0 = no)
+ * @param options The protocol, interconnect and number of cores
  */
-void hit(Set *cache, int lines_per_set, mem_addr address, int i,
-	   	char operation, int size, int verbose, int set, int tag,
-	   	int *hit_count, int *found){
-	
-	(*found) = 1;
-
-	// Incrementing appropriate counters 
-	if (operation == 'M') { 
-		(*hit_count) += 2;
-	} else {
-		(*hit_count)++;
+void simulateMulticore(char *trace_files, int num_sets, int block_size,
+		int lines_per_set, int verbose, const sim_options_t *options) {
+	FILE *fps[MAX_CORES];
+	char *names[MAX_CORES];
+	enum trace_format formats[MAX_CORES];
+	trace_reader_t *readers[MAX_CORES];
+	trace_record_t record;
+	trace_position_t where;
+	unsigned long malformed = 0;
+	int num_traces = 0, cores, core, active, c;
+	int seekable;
+	char *name;
+
+	for (name = strtok(trace_files, ","); name != NULL;
+			name = strtok(NULL, ",")) {
+		if (num_traces == MAX_CORES) {
+			printf("Error: at most %d traces\n", MAX_CORES);
+			exit(1);
+		}
+		fps[num_traces] = openTrace(name, &seekable, &formats[num_traces]);
+		if (fps[num_traces] == NULL) {
+			printf("Error opening file");
+			exit(1);
+		}
+		names[num_traces] = name;
+		readers[num_traces] = readerOpen(fps[num_traces], NULL, 0, 0);
+		num_traces++;
 	}
 
-	// Updating set LRU 
-	updateLRU(cache, set, cache[set].Lines[i].lru, lines_per_set);
+	cores = options->cores ? options->cores : num_traces;
+	if (cores < 1 || cores > MAX_CORES
+			|| (num_traces > 1 && cores != num_traces)) {
+		printf("Error: need one trace per core, or one trace and"
+				" --cores <1-%d>\n", MAX_CORES);
+		exit(1);
+	}
+	multicore_t *mc = multicoreCreate(cores, (int)log2(num_sets),
+			lines_per_set, (int)log2(block_size), options->protocol,
+			options->interconnect);
+	if (options->false_sharing) {
+		multicoreTrackSharing(mc, options->false_sharing);
+	}
 
-	// Printing for verbose mode
-	if (verbose) {
-		if (operation == 'L'){
-			printf("L %lx,%d hit\n", address, size);
-		} else if (operation == 'S') {
-			printf("S %lx,%d hit\n", address, size);	
+	// Taking a record from each trace in turn until all have ended
+	active = num_traces;
+	for (c = 0; active > 0; c = (c + 1) % num_traces) {
+		if (readers[c] == NULL) {
+			continue;
+		}
+		enum parse_result ret = readerNext(readers[c], &record, &where);
+		if (ret == PARSE_END) {
+			if (ferror(fps[c])) {
+				traceReadError(names[c], formats[c]);
+			}
+			readerClose(readers[c]);
+			closeTrace(fps[c]);
+			readers[c] = NULL;
+			active--;
+		} else if (ret == PARSE_MALFORMED) {
+			handleMalformed(&where, options, &malformed);
 		} else {
-			printf("M %lx,%d hit hit\n", address, size);
+			core = num_traces > 1 ? c : record.thread;
+			if (core >= cores) {
+				eventFlush();
+				printf("Error: record for thread %d, but only %d cores\n",
+						core, cores);
+				exit(1);
+			}
+			multicoreAccess(mc, core, record.operation, record.address,
+					record.size, verbose);
 		}
 	}
+
+	// Printing each core, the traffic, then the totals, after any buffered
+	// events
+	int hit_count = 0, miss_count = 0, eviction_count = 0;
+	eventFlush();
+	if (malformed > 0) {
+		printf("Skipped %lu malformed records\n", malformed);
+	}
+	for (c = 0; c < cores; c++) {
+		const core_stats_t *st = multicoreCoreStats(mc, c);
+		printf("core %d: hits:%lu misses:%lu evictions:%lu"
+				" coherence-misses:%lu invalidations:%lu upgrades:%lu"
+				" writebacks:%lu transfers:%lu\n", c, st->hits, st->misses,
+				st->evictions, st->coherence_misses, st->invalidations,
+				st->upgrades, st->writebacks, st->transfers);
+		hit_count += st->hits;
+		miss_count += st->misses;
+		eviction_count += st->evictions;
+	}
+	const coherence_stats_t *traffic = multicoreStats(mc);
+	if (options->interconnect == INTERCONNECT_SNOOP) {
+		printf("bus: reads:%lu read-exclusives:%lu upgrades:%lu"
+				" snoops:%lu\n", traffic->reads, traffic->read_exclusives,
+				traffic->upgrades, traffic->snoops);
+	} else {
+		printf("directory: reads:%lu read-exclusives:%lu upgrades:%lu"
+				" messages:%lu\n", traffic->reads, traffic->read_exclusives,
+				traffic->upgrades, traffic->messages);
+	}
+	if (options->false_sharing) {
+		printFalseSharing(mc, cores, options->false_sharing);
+	}
+	printf("\n");
+	printSummary(hit_count, miss_count, eviction_count);
+	multicoreFree(mc);
 }
 
 
 
 /**
- * Simulation of a cache miss.
- *
+ * Prints how many invalidations false sharing caused and the blocks that
+ * suffered most, with the cores that fought over each.
  *
- * @param cache An array of type Set that simulates a cache
- * @param lines_per_set Number of lines per cache set
- * @param address Memory location of the memory access
- * @param i Line number in the set
- * @param operation The performed operation
- * @param size Number of block bytes in each cache block 
- * @param verbose A flag which is set for verbose mode
- * @param set The set number of the memory address
- * @param tag The tag of the memory address
- * @param hit_count A counter of cache hits
- * @param miss_count A counter of cache misses
- * @param found The flag which tracks if the address was found
+ * @param mc The caches
+ * @param cores Number of cores
+ * @param top Most blocks to list
  */
-void miss(Set *cache, int lines_per_set, mem_addr address, 
-		int i, char operation, int size, int verbose, int set, 
-		int tag, int *hit_count, int *miss_count, int *found) {
-
-	(*found) = 1;
+void printFalseSharing(const multicore_t *mc, int cores, int top) {
+	sharing_entry_t *entries = malloc(top * sizeof(sharing_entry_t));
+	int i, c, n;
 
-	// Incrementing appropriate counters
-	if (operation == 'M') { 
-		(*miss_count)++;
-		(*hit_count)++;
-	} else {
-		(*miss_count)++;
+	if (entries == NULL) {
+		printf("Error allocating false sharing report\n");
+		exit(1);
 	}
+	n = multicoreFalseSharing(mc, entries, top);
+	printf("false sharing: %lu invalidations by disjoint writes\n",
+			multicoreStats(mc)->false_sharing);
+	for (i = 0; i < n; i++) {
+		printf("%3d. block %lx invalidations:%lu", i + 1, entries[i].block,
+				entries[i].invalidations);
+		if (entries[i].error) {
+			printf(" (at most %lu too high)", entries[i].error);
+		}
+		printf(" cores:");
+		for (c = 0; c < cores; c++) {
+			if (entries[i].cores & (1ULL << c)) {
+				printf("%s%d", entries[i].cores & ((1ULL << c) - 1) ? ","
+						: "", c);
+			}
+		}
+		printf("\n");
+	}
+	free(entries);
+}
 
-	// Update line attributes
-	cache[set].Lines[i].valid = 1;
-	cache[set].Lines[i].tag = tag;
 
-	// Updating set LRU 
-	updateLRU(cache, set, cache[set].Lines[i].lru, lines_per_set);
 
-	// Printing for verbose mode
-	if (verbose) {
-		if (operation == 'L'){
-			printf("L %lx,%d miss\n", address, size);
-		} else if (operation == 'S') {
-			printf("S %lx,%d miss\n", address, size);	
-		} else {
-			printf("M %lx,%d miss hit\n", address, size);
-		}
+/**
+ * Stops the run at a malformed record, or reports and counts it when
+ * malformed records are skipped.
+ *
+ * @param where Position of the record
+ * @param options Whether to skip malformed records
+ * @param malformed Count of malformed records so far
+ */
+void handleMalformed(const trace_position_t *where,
+		const sim_options_t *options, unsigned long *malformed) {
+	(*malformed)++;
+	if (!options->skip_malformed) {
+		eventFlush();
+		printf("Error: malformed record at line %lu, byte offset %lu\n",
+				where->line, where->offset);
+		exit(1);
+	}
+	if (*malformed <= MAX_MALFORMED_REPORTS) {
+		fprintf(stderr, "Skipping malformed record at line %lu,"
+				" byte offset %lu\n", where->line, where->offset);
 	}
 }
 
 
+
 /**
- * Simulation of a cache eviction.
+ * Stops the run when a trace couldn't be read to its end. The records
+ * before the failure have been simulated, but not the partial line it
+ * left, which would only be reported as malformed.
  *
+ * @param name The trace, "-" for stdin
+ * @param format The trace's format; a compressed one fails this way when
+ *   it is truncated or corrupt
+ */
+void traceReadError(const char *name, enum trace_format format) {
+	if (!strcmp(name, "-")) {
+		name = "standard input";
+	}
+	eventFlush();
+	if (format != TRACE_PLAIN) {
+		printf("Error: %s is truncated or corrupt\n", name);
+	} else {
+		printf("Error reading %s\n", name);
+	}
+	exit(1);
+}
+
+
+
+/**
+ * Simulates the accesses a plain run has buffered, and empties the buffer.
  *
  * @param cache An array of type Set that simulates a cache
+ * @param set_bits Number of set index bits
+ * @param block_bits Number of block offset bits
  * @param lines_per_set Number of lines per cache set
- * @param address Memory location of the memory access
- * @param i Line number in the set
- * @param operation The performed operation
- * @param size Number of block bytes in each cache block 
- * @param verbose A flag which is set for verbose mode
- * @param set The set number of the memory address
- * @param tag The tag of the memory address
+ * @param batch The buffered records
+ * @param buffered Number of records in the buffer, set to 0
+ * @param verbose Whether to record an event for every access
  * @param hit_count A counter of cache hits
  * @param miss_count A counter of cache misses
  * @param eviction_count A counter of cache evictions
- * @param found The flag which tracks if the address was found
  */
-void eviction(Set *cache, int lines_per_set, mem_addr address, 
-		int i, char operation, int size, int verbose, int set, 
-		int tag, int *hit_count, int *miss_count, int *eviction_count, 
-		int *found) {
-
-	(*found) = 1;
-
-	// Incrementing appropriate counters
-	if (operation == 'M') { 
-		(*miss_count)++;
-		(*hit_count)++;
-		(*eviction_count)++;
-	} else {
-		(*miss_count)++;
-		(*eviction_count)++;
-	}
-	
-	// Updating line attributes
-	if (operation == 'L'){
-		cache[set].Lines[i].valid = 1;
-		cache[set].Lines[i].tag = tag;	
-	} else {
-		cache[set].Lines[i].tag = tag;
+void flushBatch(Set *cache, int set_bits, int block_bits, int lines_per_set,
+		const trace_record_t *batch, size_t *buffered, int verbose,
+		int *hit_count, int *miss_count, int *eviction_count) {
+	if (cacheAccessBatch(cache, set_bits, block_bits, lines_per_set, batch,
+				*buffered, verbose, NULL, hit_count, miss_count,
+				eviction_count) != *buffered) {
+		printf("Error allocating cache\n");
+		exit(1);
 	}
+	*buffered = 0;
+}
 
-	// Updating set LRU
-	updateLRU(cache, set, cache[set].Lines[i].lru, lines_per_set);
 
-	// Printing for verbose mode
-	if (verbose) {
-		if (operation == 'L'){
-			printf("L %lx,%d miss eviction\n", address, size);
-		} else if (operation == 'S') {
-			printf("S %lx,%d miss eviction\n", address, size);	
-		} else {
-			printf("M %lx,%d miss eviction hit\n", address, size);
-		}
+
+/**
+ * Shortens a sampling skip so it ends no later than --checkpoint-after.
+ *
+ * @param skip Records the sampling period skips
+ * @param records Records read so far
+ * @param options The fast-forward length, 0 for none
+ * @return Records to skip
+ */
+unsigned long clampSkip(unsigned long skip, unsigned long records,
+		const sim_options_t *options) {
+	if (options->checkpoint_after != 0
+			&& skip > options->checkpoint_after - records) {
+		return options->checkpoint_after - records;
 	}
+	return skip;
 }
 
 
 
 /**
- * Updates Least Recently Used bit in a set after a memory access.
- *
+ * Spreads set indices so a sample of 1 in 2^k sets isn't biased towards any
+ * address stride.
  *
- * @param cache An array of type Set that simulates a cache
- * @param set_num The set number in the cache that needs to be updated
- * @param prev_lru The previous LRU at line that was recently accessed
- * @param lines_per_set Number of lines per cache set
+ * @param set The set index
+ * @return A well mixed hash of the set index
  */
-void updateLRU(Set *cache, int set_num,int prev_lru, int lines_per_set) { 
-	int i;
+unsigned int hashSet(unsigned int set) {
+	set ^= set >> 16;
+	set *= 0x7feb352dU;
+	set ^= set >> 15;
+	set *= 0x846ca68bU;
+	set ^= set >> 16;
+	return set;
+}
 
-	// Update valid lines LRU
-	for (i = 0; i < lines_per_set; i++) {
-		if (cache[set_num].Lines[i].valid == 1) {
 
-			// Only updating LRU lower than modified lines LRU
-			if (cache[set_num].Lines[i].lru <= prev_lru) {
-				if(cache[set_num].Lines[i].lru == prev_lru) {
 
-					// Setting modified lines LRU to 0 
-					cache[set_num].Lines[i].lru = 0;
-				} else {
+/**
+ * Simulates one access under set sampling. The access is counted whether or
+ * not its set is sampled, and with split set each block it touches is
+ * treated as an access of its own. A sampled set is looked up in the
+ * smaller cache by its slot, with the tag the full cache would have kept.
+ *
+ * @param cache The cache of sampled sets
+ * @param sample The sampled sets and their counts
+ * @param set_bits Number of set bits of the full cache
+ * @param block_bits Number of block bits
+ * @param lines_per_set Number of lines per cache set
+ * @param operation L, S or M
+ * @param address Address of the access
+ * @param size Bytes accessed
+ * @param split Whether to split the access at block boundaries
+ * @param counted Whether the access is measured, rather than warming
+ * @param hit_count Hits in the sampled sets
+ * @param miss_count Misses in the sampled sets
+ * @param eviction_count Evictions in the sampled sets
+ * @return Number of blocks the access was split into
+ */
+int sampleAccess(Set *cache, set_sample_t *sample, int set_bits,
+		int block_bits, int lines_per_set, char operation, mem_addr address,
+		int size, int split, int counted, int *hit_count, int *miss_count,
+		int *eviction_count) {
+	mem_addr block_mask = (1UL << block_bits) - 1;
+	int blocks = split ? (int)(((address & block_mask) + size - 1)
+			>> block_bits) + 1 : 1;
+	int b, left = size;
+
+	// Counted in blocks, as in cacheAccessSplit, since an end address
+	// wraps for an access at the top of memory
+	for (b = 0; b < blocks; b++) {
+		mem_addr next = (address | block_mask) + 1;
+		int piece = split && next - address < (mem_addr)left
+			? (int)(next - address) : left;
+		unsigned int set = (unsigned int)(address >> block_bits)
+			& ((1U << set_bits) - 1);
+		left -= piece;
+		if (counted) {
+			sample->accesses += operation == 'M' ? 2 : 1;
+		}
 
-					// Incrementing nonmodified lines
-					cache[set_num].Lines[i].lru++;
+		if ((hashSet(set) & sample->mask) == 0) {
+			unsigned int lo = 0, hi = sample->count;
+			while (lo < hi) {
+				unsigned int mid = lo + (hi - lo) / 2;
+				if (sample->sets[mid] < set) {
+					lo = mid + 1;
+				} else {
+					hi = mid;
 				}
 			}
+			mem_addr slot_address = (address >> (set_bits + block_bits)
+					<< (sample->slot_bits + block_bits))
+				| ((mem_addr)lo << block_bits) | (address & block_mask);
+			int misses_before = *miss_count;
+			cacheAccess(cache, sample->slot_bits, block_bits, lines_per_set,
+					operation, slot_address, piece, hit_count, miss_count,
+					eviction_count);
+			if (counted) {
+				sample->misses[lo] += *miss_count - misses_before;
+			}
 		}
+		address = next;
 	}
+	return blocks;
+}
+
+
+
+/**
+ * Prints counts estimated from a set-sampled run, and a 95% confidence
+ * interval for the miss ratio. Every access was counted, so only misses
+ * and evictions are estimated, by scaling up those of the sampled sets;
+ * hits are the accesses less the misses. Sets are the sampling units, so
+ * the interval comes from the spread of the per-set misses. Scaling hits
+ * the same way, or by the share of accesses that fell in the sample, is
+ * thrown far off by a few hot sets.
+ *
+ * @param miss_count Misses in the sampled sets
+ * @param eviction_count Evictions in the sampled sets
+ * @param num_sets Number of sets in the cache
+ * @param sample The sampled sets and their counts
+ */
+void printSetSampleSummary(int miss_count, int eviction_count, int num_sets,
+		const set_sample_t *sample) {
+	double scale = (double)num_sets / sample->count;
+	double accesses = sample->accesses;
+	double misses = miss_count * scale;
+	double mean = (double)miss_count / sample->count;
+	double spread = 0, margin = 0;
+	unsigned int i;
+
+	for (i = 0; i < sample->count; i++) {
+		spread += (sample->misses[i] - mean) * (sample->misses[i] - mean);
+	}
+	if (sample->count > 1 && accesses > 0) {
+		double variance = num_sets * scale * spread / (sample->count - 1)
+			* (1 - 1 / scale);
+		margin = 1.96 * sqrt(variance) / accesses;
+	}
+	if (misses > accesses) {
+		misses = accesses;
+	}
+
+	printf("Set sampling: %u of %d sets, %lu accesses, misses scaled by"
+			" %.2f\n", sample->count, num_sets, sample->accesses, scale);
+	printf("Miss ratio: %.6f +/- %.6f (95%% confidence)\n",
+			accesses > 0 ? misses / accesses : 0, margin);
+	printSummary((int)(accesses - misses + 0.5), (int)(misses + 0.5),
+			(int)(eviction_count * scale + 0.5));
 }
@@ -0,0 +1,111 @@
+/*
+ * csimreplay.c
+ *
+ * Example user of libcsim: replays a trace file through the shared library
+ * with csimAccessN, a buffer of records at a time, and prints the counts
+ * in the same form as csim. make check compares the two, so the library
+ * and the simulator can't drift apart.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include "libcsim.h"
+
+// Records handed to the library per call
+#define REPLAY_BATCH_SIZE 1024
+
+
+
+/**
+ * Prints out a reminder of how to run the program.
+ *
+ * @param executable_name String containing the name of the executable.
+ */
+void usage(char *executable_name) {
+	printf("Usage: %s -s <s> -E <E> -b <b> -t <tracefile>\n",
+			executable_name);
+}
+
+
+
+/**
+ * Replays the trace and prints the counts.
+ *
+ * @param argc Number of arguments from the command line
+ * @param argv Arguments from the command line
+ */
+int main(int argc, char *argv[]) {
+	csim_record_t records[REPLAY_BATCH_SIZE];
+	csim_stats_t stats;
+	char line[256];
+	int set_bits = -1, lines_per_set = -1, block_bits = -1;
+	char *trace_filename = NULL;
+	size_t buffered = 0;
+	int c;
+
+	while ((c = getopt(argc, argv, "s:E:b:t:")) != -1) {
+		switch (c) {
+			case 's':
+				set_bits = atoi(optarg);
+				break;
+			case 'E':
+				lines_per_set = atoi(optarg);
+				break;
+			case 'b':
+				block_bits = atoi(optarg);
+				break;
+			case 't':
+				trace_filename = optarg;
+				break;
+			default:
+				usage(argv[0]);
+				exit(1);
+		}
+	}
+	if (trace_filename == NULL) {
+		usage(argv[0]);
+		exit(1);
+	}
+
+	csim_t *sim = csimCreate();
+	if (sim == NULL
+			|| csimConfigure(sim, set_bits, lines_per_set, block_bits)) {
+		printf("Error: can't simulate -s %d -E %d -b %d\n", set_bits,
+				lines_per_set, block_bits);
+		exit(1);
+	}
+	FILE *fp = fopen(trace_filename, "r");
+	if (fp == NULL) {
+		printf("Error opening %s\n", trace_filename);
+		exit(1);
+	}
+
+	// Instruction fetches and anything unparsable are passed over, as the
+	// library ignores operations other than L, S and M
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		csim_record_t *record = &records[buffered];
+		if (sscanf(line, " %c %lx,%d", &record->operation, &record->address,
+					&record->size) != 3) {
+			continue;
+		}
+		if (++buffered == REPLAY_BATCH_SIZE) {
+			if (csimAccessN(sim, records, buffered, NULL)) {
+				printf("Error: out of memory\n");
+				exit(1);
+			}
+			buffered = 0;
+		}
+	}
+	if (csimAccessN(sim, records, buffered, NULL)) {
+		printf("Error: out of memory\n");
+		exit(1);
+	}
+	fclose(fp);
+
+	csimGetStats(sim, &stats);
+	printf("hits:%lu misses:%lu evictions:%lu\n", stats.hits, stats.misses,
+			stats.evictions);
+	csimDestroy(sim);
+	return 0;
+}
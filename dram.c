@@ -0,0 +1,370 @@
+/*
+ * dram.c
+ *
+ * An open-page DRAM model. Block addresses are split into channel, rank,
+ * bank, row and column by a map such as RoRaBaChCo, which names the fields
+ * from the top bit down; the row takes every bit above the others. Each
+ * bank keeps its last row open, so a request is a row hit, a row miss on
+ * an idle bank, or a conflict that has to close the open row first.
+ *
+ * Requests are served in arrival order per bank and then queue for their
+ * channel's data bus. Completions wait in a min-heap per channel, so the
+ * requests still in flight when one arrives are found by popping the heap
+ * rather than by scanning. A channel holds at most queue_depth requests;
+ * one that arrives to a full queue waits for the soonest to complete, and
+ * the wait is added to every later arrival, as a core stalls when the
+ * controller can take no more. The queues, and the time they cover, stay
+ * bounded however long the trace is.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "dram.h"
+
+// Fields of a DRAM address
+enum dram_field {
+	FIELD_ROW,
+	FIELD_RANK,
+	FIELD_BANK,
+	FIELD_CHANNEL,
+	FIELD_COLUMN,
+	NUM_FIELDS
+};
+
+static const char *field_names[NUM_FIELDS] = {
+	"Ro", "Ra", "Ba", "Ch", "Co"
+};
+
+// Row buffer of one bank
+typedef struct dram_bank {
+	long long open_row;         /* -1 when closed */
+	unsigned long long ready;   /* cycle it can start the next request */
+} dram_bank_t;
+
+// Data bus and in-flight requests of one channel
+typedef struct dram_channel {
+	unsigned long long bus_ready;
+	unsigned long long *heap;   /* completion times, soonest first */
+	size_t heap_count;
+} dram_channel_t;
+
+struct dram {
+	dram_config_t config;
+	int order[NUM_FIELDS - 1];  /* fields below the row, lowest first */
+	int bits[NUM_FIELDS];
+	dram_bank_t *banks;
+	dram_channel_t *channels;
+	unsigned long long *bytes;  /* moved per epoch */
+	size_t num_epochs;
+	unsigned long long delay;   /* cycles arrivals are held back */
+	dram_stats_t stats;
+};
+
+
+
+/**
+ * Returns log2 of a power of two, or -1 for anything else.
+ */
+static int log2Exact(long n) {
+	int bits = 0;
+
+	if (n <= 0 || (n & (n - 1))) {
+		return -1;
+	}
+	while ((1L << bits) < n) {
+		bits++;
+	}
+	return bits;
+}
+
+
+
+/**
+ * Reads a map such as RoRaBaChCo into the order of the fields below the
+ * row. Every field must appear once, with the row first.
+ *
+ * @return 0 on success, -1 for a bad map
+ */
+static int parseMap(dram_t *dram, const char *map) {
+	int seen[NUM_FIELDS] = { 0 };
+	int pos, f, n = NUM_FIELDS - 1;
+
+	if (strlen(map) != 2 * NUM_FIELDS || strncmp(map, "Ro", 2)) {
+		return -1;
+	}
+	for (pos = 2; pos < 2 * NUM_FIELDS; pos += 2) {
+		for (f = 0; f < NUM_FIELDS; f++) {
+			if (!strncmp(map + pos, field_names[f], 2)) {
+				break;
+			}
+		}
+		if (f == NUM_FIELDS || f == FIELD_ROW || seen[f]) {
+			return -1;
+		}
+		seen[f] = 1;
+		dram->order[--n] = f;
+	}
+	return 0;
+}
+
+
+
+/**
+ * Creates memory with every row closed and nothing in flight.
+ *
+ * @param config Geometry, map and timing
+ * @return The model, or NULL for a bad configuration
+ */
+dram_t *dramCreate(const dram_config_t *config) {
+	dram_t *dram = calloc(1, sizeof(dram_t));
+	int num_banks, i;
+
+	if (dram == NULL) {
+		printf("Error allocating DRAM\n");
+		exit(1);
+	}
+	dram->config = *config;
+	dram->bits[FIELD_CHANNEL] = log2Exact(config->channels);
+	dram->bits[FIELD_RANK] = log2Exact(config->ranks);
+	dram->bits[FIELD_BANK] = log2Exact(config->banks);
+	dram->bits[FIELD_COLUMN] = log2Exact(config->row_bytes)
+		- config->block_bits;
+	if (dram->bits[FIELD_CHANNEL] < 0 || dram->bits[FIELD_RANK] < 0
+			|| dram->bits[FIELD_BANK] < 0 || dram->bits[FIELD_COLUMN] < 0
+			|| config->epoch == 0 || config->queue_depth < 1
+			|| parseMap(dram, config->map)) {
+		free(dram);
+		return NULL;
+	}
+
+	num_banks = config->channels * config->ranks * config->banks;
+	dram->banks = malloc(num_banks * sizeof(dram_bank_t));
+	dram->channels = calloc(config->channels, sizeof(dram_channel_t));
+	if (dram->banks == NULL || dram->channels == NULL) {
+		printf("Error allocating DRAM\n");
+		exit(1);
+	}
+	for (i = 0; i < num_banks; i++) {
+		dram->banks[i].open_row = -1;
+		dram->banks[i].ready = 0;
+	}
+	for (i = 0; i < config->channels; i++) {
+		dram->channels[i].heap = malloc(config->queue_depth
+				* sizeof(unsigned long long));
+		if (dram->channels[i].heap == NULL) {
+			printf("Error allocating DRAM queue\n");
+			exit(1);
+		}
+	}
+	return dram;
+}
+
+
+
+/**
+ * Adds a completion time to a channel's heap, which must have room.
+ */
+static void heapPush(dram_channel_t *channel, unsigned long long done) {
+	size_t i = channel->heap_count++;
+
+	while (i > 0 && channel->heap[(i - 1) / 2] > done) {
+		channel->heap[i] = channel->heap[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	channel->heap[i] = done;
+}
+
+
+
+/**
+ * Removes the soonest completion time from a channel's heap.
+ */
+static void heapPop(dram_channel_t *channel) {
+	unsigned long long last = channel->heap[--channel->heap_count];
+	size_t i = 0, child;
+
+	while ((child = 2 * i + 1) < channel->heap_count) {
+		if (child + 1 < channel->heap_count
+				&& channel->heap[child + 1] < channel->heap[child]) {
+			child++;
+		}
+		if (channel->heap[child] >= last) {
+			break;
+		}
+		channel->heap[i] = channel->heap[child];
+		i = child;
+	}
+	channel->heap[i] = last;
+}
+
+
+
+/**
+ * Counts the bytes of a request in the epoch it completes in.
+ */
+static void countBytes(dram_t *dram, unsigned long long done) {
+	size_t epoch = done / dram->config.epoch;
+
+	if (epoch >= dram->num_epochs) {
+		size_t num_epochs = dram->num_epochs ? dram->num_epochs : 64;
+		while (num_epochs <= epoch) {
+			num_epochs *= 2;
+		}
+		dram->bytes = realloc(dram->bytes,
+				num_epochs * sizeof(unsigned long long));
+		if (dram->bytes == NULL) {
+			printf("Error allocating DRAM bandwidth samples\n");
+			exit(1);
+		}
+		memset(dram->bytes + dram->num_epochs, 0,
+				(num_epochs - dram->num_epochs) * sizeof(unsigned long long));
+		dram->num_epochs = num_epochs;
+	}
+	dram->bytes[epoch] += 1UL << dram->config.block_bits;
+}
+
+
+
+/**
+ * Serves one block read or writeback.
+ *
+ * @param dram The memory
+ * @param address Any address in the block
+ * @param write Whether the block is written back rather than read
+ * @param arrival Cycle the request reaches the memory controller, before
+ *   any earlier waits for a queue slot
+ */
+void dramRequest(dram_t *dram, mem_addr address, int write,
+		unsigned long long arrival) {
+	mem_addr rest = address >> dram->config.block_bits;
+	int value[NUM_FIELDS], i;
+	unsigned long long start, data;
+
+	// Decoding the fields, lowest first, leaving the row
+	for (i = 0; i < NUM_FIELDS - 1; i++) {
+		int f = dram->order[i];
+		value[f] = (int)(rest & ((1UL << dram->bits[f]) - 1));
+		rest >>= dram->bits[f];
+	}
+	dram_channel_t *channel = &dram->channels[value[FIELD_CHANNEL]];
+	dram_bank_t *bank = &dram->banks[(value[FIELD_CHANNEL]
+			* dram->config.ranks + value[FIELD_RANK]) * dram->config.banks
+		+ value[FIELD_BANK]];
+
+	// Retiring what completed before this arrived; a full queue holds
+	// the request, and everything after it, until a slot frees
+	arrival += dram->delay;
+	while (channel->heap_count > 0 && channel->heap[0] <= arrival) {
+		heapPop(channel);
+	}
+	if (channel->heap_count == (size_t)dram->config.queue_depth) {
+		unsigned long long wait = channel->heap[0] - arrival;
+		dram->delay += wait;
+		dram->stats.stalled += wait;
+		arrival += wait;
+		heapPop(channel);
+	}
+	dram->stats.queued += channel->heap_count;
+	if (channel->heap_count > dram->stats.max_queued) {
+		dram->stats.max_queued = channel->heap_count;
+	}
+
+	// Row buffer
+	start = arrival > bank->ready ? arrival : bank->ready;
+	if (bank->open_row == (long long)rest) {
+		dram->stats.row_hits++;
+		data = start + dram->config.t_cas;
+	} else if (bank->open_row < 0) {
+		dram->stats.row_misses++;
+		data = start + dram->config.t_rcd + dram->config.t_cas;
+	} else {
+		dram->stats.row_conflicts++;
+		data = start + dram->config.t_rp + dram->config.t_rcd
+			+ dram->config.t_cas;
+	}
+	bank->open_row = (long long)rest;
+
+	// Data bus
+	if (data < channel->bus_ready) {
+		data = channel->bus_ready;
+	}
+	bank->ready = data;
+	channel->bus_ready = data + dram->config.t_burst;
+	heapPush(channel, channel->bus_ready);
+
+	if (write) {
+		dram->stats.writes++;
+	} else {
+		dram->stats.reads++;
+	}
+	dram->stats.latency += channel->bus_ready - arrival;
+	if (channel->bus_ready > dram->stats.end) {
+		dram->stats.end = channel->bus_ready;
+	}
+	countBytes(dram, channel->bus_ready);
+}
+
+
+
+/**
+ * Returns the counts so far.
+ */
+const dram_stats_t *dramStats(const dram_t *dram) {
+	return &dram->stats;
+}
+
+
+
+/**
+ * Prints the request counts, row buffer outcomes, queueing and bandwidth.
+ *
+ * @param dram The memory
+ * @param out Where to write bytes per epoch as CSV, or NULL
+ */
+void dramReport(const dram_t *dram, FILE *out) {
+	const dram_stats_t *stats = &dram->stats;
+	unsigned long requests = stats->reads + stats->writes;
+	size_t last_epoch = stats->end / dram->config.epoch, i;
+	unsigned long long peak = 0;
+
+	for (i = 0; requests > 0 && i <= last_epoch; i++) {
+		if (dram->bytes[i] > peak) {
+			peak = dram->bytes[i];
+		}
+		if (out != NULL) {
+			fprintf(out, "%lu,%llu\n", (unsigned long)(i * dram->config.epoch),
+					dram->bytes[i]);
+		}
+	}
+
+	printf("DRAM: reads:%lu writes:%lu row-hits:%lu row-misses:%lu"
+			" row-conflicts:%lu\n", stats->reads, stats->writes,
+			stats->row_hits, stats->row_misses, stats->row_conflicts);
+	printf("DRAM: latency:%.2f queued:%.2f max-queued:%lu stalled:%llu"
+			" bytes/cycle:%.3f peak:%.3f\n",
+			requests ? (double)stats->latency / requests : 0,
+			requests ? (double)stats->queued / requests : 0,
+			stats->max_queued, stats->stalled,
+			stats->end ? (double)(requests << dram->config.block_bits)
+				/ stats->end : 0,
+			(double)peak / dram->config.epoch);
+}
+
+
+
+/**
+ * Frees the memory model.
+ *
+ * @param dram The memory
+ */
+void dramFree(dram_t *dram) {
+	int i;
+
+	for (i = 0; i < dram->config.channels; i++) {
+		free(dram->channels[i].heap);
+	}
+	free(dram->channels);
+	free(dram->banks);
+	free(dram->bytes);
+	free(dram);
+}
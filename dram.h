@@ -0,0 +1,64 @@
+/*
+ * dram.h - Memory behind the cache: channels, ranks, banks and open rows
+ */
+
+#ifndef CSIM_DRAM_H
+#define CSIM_DRAM_H
+
+#include <stdio.h>
+#include "cache.h"
+
+// Geometry, address mapping and timing of the memory
+typedef struct dram_config {
+	int channels, ranks, banks;
+	int row_bytes;            /* bytes in a bank's row buffer */
+	int block_bits;           /* cache block offset bits, one burst each */
+	const char *map;          /* fields from the top bit down, e.g. RoRaBaChCo */
+	int t_cas, t_rcd, t_rp;   /* column access, activate and precharge */
+	int t_burst;              /* cycles a block holds the channel's bus */
+	int queue_depth;          /* requests a channel holds in flight */
+	unsigned long epoch;      /* cycles per bandwidth sample */
+} dram_config_t;
+
+typedef struct dram_stats {
+	unsigned long reads, writes;
+	unsigned long row_hits;        /* the row was already open */
+	unsigned long row_misses;      /* the bank had no open row */
+	unsigned long row_conflicts;   /* another row had to be closed first */
+	unsigned long long latency;    /* arrival to data, summed */
+	unsigned long long queued;     /* requests in flight, summed on arrival */
+	unsigned long max_queued;
+	unsigned long long stalled;    /* cycles arrivals waited for a slot */
+	unsigned long long end;        /* cycle the last request completes */
+} dram_stats_t;
+
+typedef struct dram dram_t;
+
+/*
+ * dramCreate - Create memory with every row closed. Returns NULL for an
+ *     unknown map, sizes that aren't powers of two or a queue depth below 1.
+ */
+dram_t *dramCreate(const dram_config_t *config);
+
+/*
+ * dramRequest - Read or write back the block holding address, arriving at
+ *     cycle arrival. Arrivals must not go backwards. A request that finds
+ *     its channel's queue full waits for a slot, and holds back every later
+ *     arrival by as long.
+ */
+void dramRequest(dram_t *dram, mem_addr address, int write,
+		unsigned long long arrival);
+
+/* Counts so far */
+const dram_stats_t *dramStats(const dram_t *dram);
+
+/*
+ * dramReport - Print the counts. With out set, also write bytes moved per
+ *     epoch as CSV.
+ */
+void dramReport(const dram_t *dram, FILE *out);
+
+/* Free the memory model */
+void dramFree(dram_t *dram);
+
+#endif /* CSIM_DRAM_H */
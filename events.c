@@ -0,0 +1,202 @@
+/*
+ * events.c - Buffered verbose event stream and binary event log
+ *
+ * Verbose output used to be one printf per access, which on long traces
+ * costs far more than the simulation itself. Lines are now formatted by hand
+ * into a large buffer that is handed to stdio in big chunks. The text is
+ * byte-identical to the old printf output.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "events.h"
+
+// Longest line we can emit: "M <16 hex>,<int> miss eviction hit\n"
+#define EVENT_MAX_LINE 64
+
+// Number of binary records buffered before they are written out
+#define EVENT_LOG_RECORDS 4096
+
+static int text_enabled = 0;
+static char text_buffer[EVENT_BUFFER_SIZE];
+static size_t text_used = 0;
+
+static FILE *log_fp = NULL;
+static event_record_t log_buffer[EVENT_LOG_RECORDS];
+static size_t log_used = 0;
+
+static const char hex_digits[] = "0123456789abcdef";
+
+
+
+/**
+ * Writes the buffered binary records to the log file.
+ */
+static void flushLog(void) {
+	if (log_used > 0) {
+		if (fwrite(log_buffer, sizeof(event_record_t), log_used, log_fp)
+				!= log_used) {
+			printf("Error writing event log\n");
+			exit(1);
+		}
+		log_used = 0;
+	}
+}
+
+
+
+/**
+ * Starts the event stream.
+ *
+ * @param text Whether to print the verbose text stream to stdout
+ * @param log_path File to write binary records to, or NULL for none
+ */
+void eventOpen(int text, const char *log_path) {
+	text_enabled = text;
+	text_used = 0;
+	log_used = 0;
+
+	if (log_path != NULL) {
+		log_fp = fopen(log_path, "wb");
+		if (log_fp == NULL) {
+			printf("Error opening event log");
+			exit(1);
+		}
+		fwrite(EVENT_LOG_MAGIC, 1, strlen(EVENT_LOG_MAGIC), log_fp);
+	}
+}
+
+
+
+/**
+ * Records the outcome of one trace record.
+ *
+ * @param operation The performed operation ('L', 'S' or 'M')
+ * @param address Memory location of the memory access
+ * @param size Number of bytes accessed
+ * @param outcome EVENT_* bits describing what happened
+ */
+void eventRecord(char operation, unsigned long address, int size,
+		unsigned int outcome) {
+	if (log_fp != NULL) {
+		event_record_t *rec = &log_buffer[log_used++];
+		rec->address = address;
+		rec->size = (uint32_t)size;
+		rec->operation = (uint8_t)operation;
+		rec->outcome = (uint8_t)outcome;
+		rec->reserved = 0;
+		if (log_used == EVENT_LOG_RECORDS) {
+			flushLog();
+		}
+	}
+
+	if (!text_enabled) {
+		return;
+	}
+
+	if (text_used > EVENT_BUFFER_SIZE - EVENT_MAX_LINE) {
+		eventFlush();
+	}
+
+	char *p = text_buffer + text_used;
+	char digits[20];
+	int n = 0;
+
+	*p++ = operation;
+	*p++ = ' ';
+
+	// Address in lower case hex without leading zeros
+	do {
+		digits[n++] = hex_digits[address & 0xf];
+		address >>= 4;
+	} while (address != 0);
+	while (n > 0) {
+		*p++ = digits[--n];
+	}
+	*p++ = ',';
+
+	// Size in decimal
+	unsigned int value = (unsigned int)size;
+	if (size < 0) {
+		*p++ = '-';
+		value = 0u - value;
+	}
+	do {
+		digits[n++] = (char)('0' + value % 10);
+		value /= 10;
+	} while (value != 0);
+	while (n > 0) {
+		*p++ = digits[--n];
+	}
+
+	if (outcome & EVENT_HIT) {
+		memcpy(p, " hit", 4);
+		p += 4;
+	} else {
+		memcpy(p, " miss", 5);
+		p += 5;
+		if (outcome & EVENT_EVICTION) {
+			memcpy(p, " eviction", 9);
+			p += 9;
+		}
+	}
+
+	// The store half of a modify always hits
+	if (operation == 'M') {
+		memcpy(p, " hit", 4);
+		p += 4;
+	}
+	*p++ = '\n';
+
+	text_used = p - text_buffer;
+}
+
+
+
+/**
+ * Adds a preformatted line to the text stream. Nothing goes to the binary
+ * log.
+ *
+ * @param line The line, ending in a newline
+ * @param len Number of bytes in the line
+ */
+void eventText(const char *line, size_t len) {
+	if (!text_enabled) {
+		return;
+	}
+	if (text_used > EVENT_BUFFER_SIZE - len) {
+		eventFlush();
+	}
+	memcpy(text_buffer + text_used, line, len);
+	text_used += len;
+}
+
+
+
+/**
+ * Hands buffered text to stdio so it stays ordered with later printf calls.
+ */
+void eventFlush(void) {
+	if (text_used > 0) {
+		fwrite(text_buffer, 1, text_used, stdout);
+		text_used = 0;
+	}
+	if (log_fp != NULL) {
+		flushLog();
+	}
+}
+
+
+
+/**
+ * Flushes and closes the event stream.
+ */
+void eventClose(void) {
+	eventFlush();
+	if (log_fp != NULL) {
+		fclose(log_fp);
+		log_fp = NULL;
+	}
+	text_enabled = 0;
+}
@@ -0,0 +1,53 @@
+/*
+ * events.h - Buffered verbose event stream and binary event log
+ */
+
+#ifndef CSIM_EVENTS_H
+#define CSIM_EVENTS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Outcome bits of a single trace record
+#define EVENT_HIT      0x1
+#define EVENT_MISS     0x2
+#define EVENT_EVICTION 0x4
+
+// Size of the user-space buffer the text stream is formatted into
+#define EVENT_BUFFER_SIZE (1 << 20)
+
+// Magic at the start of a binary event log
+#define EVENT_LOG_MAGIC "CSIMEVT1"
+
+// One binary event log record, written once per simulated access
+typedef struct event_record {
+	uint64_t address;
+	uint32_t size;
+	uint8_t operation;  /* 'L', 'S' or 'M' */
+	uint8_t outcome;    /* EVENT_* bits */
+	uint16_t reserved;
+} event_record_t;
+
+/*
+ * eventOpen - Start the event stream. Text goes to stdout when text is set,
+ *     binary records go to log_path when it is not NULL.
+ */
+void eventOpen(int text, const char *log_path);
+
+/* Record the outcome of one trace record */
+void eventRecord(char operation, unsigned long address, int size,
+		unsigned int outcome);
+
+/*
+ * eventText - Add a line of len bytes, newline included, to the text
+ *     stream. For models whose events the binary log can't describe.
+ */
+void eventText(const char *line, size_t len);
+
+/* Flush any buffered output so stdio can safely print after it */
+void eventFlush(void);
+
+/* Flush and close the event stream */
+void eventClose(void);
+
+#endif /* CSIM_EVENTS_H */
@@ -0,0 +1,277 @@
+/*
+ * fullassoc.c
+ *
+ * A fully associative cache can't afford the linear tag scan and LRU
+ * renumbering the set-associative model does, since both walk every line.
+ * Here the lines themselves are the slot pool: an open-addressing hash
+ * table with linear probing maps a tag to its line, and the lines are
+ * threaded on an intrusive doubly linked list from most to least recently
+ * used. A hit, a fill and an eviction each touch a constant number of
+ * slots. Empty lines are handed out lowest first, as the scan would.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "fullassoc.h"
+
+// No line, in the list links and the hash table
+#define NO_LINE -1
+
+struct fa_index {
+	Line *lines;            /* the slot pool */
+	int *prev, *next;       /* recency list, one link pair per line */
+	int head, tail;         /* most and least recently used */
+	int *table;             /* line of each bucket, or NO_LINE */
+	unsigned int mask;      /* buckets - 1 */
+	int *free_lines;        /* empty lines, lowest first */
+	int num_free, next_free;
+};
+
+
+
+/**
+ * Returns the first bucket to probe for a tag. The high half is folded in,
+ * which leaves tags below 2^32 where they always were.
+ */
+static unsigned int bucketOf(const fa_index_t *fa, mem_addr tag) {
+	return ((unsigned int)(tag ^ (tag >> 32)) * 2654435761u) & fa->mask;
+}
+
+
+
+/**
+ * Adds a line to the hash table under its tag.
+ */
+static void tableInsert(fa_index_t *fa, int line) {
+	unsigned int b = bucketOf(fa, fa->lines[line].tag);
+
+	while (fa->table[b] != NO_LINE) {
+		b = (b + 1) & fa->mask;
+	}
+	fa->table[b] = line;
+}
+
+
+
+/**
+ * Removes a line from the hash table, shifting later entries of its probe
+ * run back so no tombstones are left behind.
+ */
+static void tableRemove(fa_index_t *fa, int line) {
+	unsigned int b = bucketOf(fa, fa->lines[line].tag), next, home;
+
+	while (fa->table[b] != line) {
+		b = (b + 1) & fa->mask;
+	}
+	for (next = (b + 1) & fa->mask; fa->table[next] != NO_LINE;
+			next = (next + 1) & fa->mask) {
+		home = bucketOf(fa, fa->lines[fa->table[next]].tag);
+
+		// Entries whose home lies cyclically in (b, next] stay put
+		if (((next - home) & fa->mask) >= ((next - b) & fa->mask)) {
+			fa->table[b] = fa->table[next];
+			b = next;
+		}
+	}
+	fa->table[b] = NO_LINE;
+}
+
+
+
+/**
+ * Unlinks a line from the recency list.
+ */
+static void listRemove(fa_index_t *fa, int line) {
+	if (fa->prev[line] != NO_LINE) {
+		fa->next[fa->prev[line]] = fa->next[line];
+	} else {
+		fa->head = fa->next[line];
+	}
+	if (fa->next[line] != NO_LINE) {
+		fa->prev[fa->next[line]] = fa->prev[line];
+	} else {
+		fa->tail = fa->prev[line];
+	}
+}
+
+
+
+/**
+ * Links a line in as the most recently used.
+ */
+static void listPush(fa_index_t *fa, int line) {
+	fa->prev[line] = NO_LINE;
+	fa->next[line] = fa->head;
+	if (fa->head != NO_LINE) {
+		fa->prev[fa->head] = line;
+	} else {
+		fa->tail = line;
+	}
+	fa->head = line;
+}
+
+
+
+/**
+ * Indexes the lines of a one-set cache.
+ *
+ * @param lines The lines, with valid lines ranked 0 up by their lru
+ * @param lines_per_set Number of lines
+ * @return The index, to be released with faFree, or NULL when out of
+ *   memory
+ */
+fa_index_t *faCreate(Line *lines, int lines_per_set) {
+	fa_index_t *fa = calloc(1, sizeof(fa_index_t));
+	unsigned int buckets = 2;
+	int i, *by_rank;
+
+	while (buckets < 2u * lines_per_set) {
+		buckets <<= 1;
+	}
+	if (fa != NULL) {
+		fa->prev = malloc(lines_per_set * sizeof(int));
+		fa->next = malloc(lines_per_set * sizeof(int));
+		fa->free_lines = malloc(lines_per_set * sizeof(int));
+		fa->table = malloc(buckets * sizeof(int));
+	}
+	by_rank = malloc(lines_per_set * sizeof(int));
+	if (fa == NULL || fa->prev == NULL || fa->next == NULL
+			|| fa->free_lines == NULL || fa->table == NULL
+			|| by_rank == NULL) {
+		if (fa != NULL) {
+			faFree(fa);
+		}
+		free(by_rank);
+		return NULL;
+	}
+	fa->lines = lines;
+	fa->mask = buckets - 1;
+	fa->head = fa->tail = NO_LINE;
+	for (i = 0; i < (int)buckets; i++) {
+		fa->table[i] = NO_LINE;
+	}
+
+	// Valid lines go on the list in recency order, empty ones in order
+	for (i = 0; i < lines_per_set; i++) {
+		by_rank[i] = NO_LINE;
+	}
+	for (i = 0; i < lines_per_set; i++) {
+		if (lines[i].valid && lines[i].lru < (unsigned int)lines_per_set) {
+			by_rank[lines[i].lru] = i;
+			tableInsert(fa, i);
+		} else {
+			fa->free_lines[fa->num_free++] = i;
+		}
+	}
+	for (i = lines_per_set - 1; i >= 0; i--) {
+		if (by_rank[i] != NO_LINE) {
+			listPush(fa, by_rank[i]);
+		}
+	}
+	free(by_rank);
+	return fa;
+}
+
+
+
+/**
+ * Looks a tag up and fills it on a miss.
+ *
+ * @param fa The index
+ * @param tag The tag being accessed
+ * @return ACCESS_HIT, ACCESS_MISS or ACCESS_EVICTION
+ */
+enum access_outcome faAccess(fa_index_t *fa, mem_addr tag) {
+	int line = faLookup(fa, tag);
+	enum access_outcome outcome = ACCESS_HIT;
+
+	if (line == NO_LINE) {
+		if (fa->next_free < fa->num_free) {
+			line = fa->free_lines[fa->next_free++];
+			outcome = ACCESS_MISS;
+		} else {
+			line = fa->tail;
+			tableRemove(fa, line);
+			listRemove(fa, line);
+			outcome = ACCESS_EVICTION;
+		}
+		fa->lines[line].valid = 1;
+		fa->lines[line].tag = tag;
+		tableInsert(fa, line);
+		listPush(fa, line);
+	} else if (line != fa->head) {
+		listRemove(fa, line);
+		listPush(fa, line);
+	}
+	return outcome;
+}
+
+
+
+/**
+ * Finds the line holding a tag.
+ *
+ * @param fa The index
+ * @param tag The tag to look for
+ * @return The line, or -1 if the tag isn't cached
+ */
+int faLookup(const fa_index_t *fa, mem_addr tag) {
+	unsigned int b = bucketOf(fa, tag);
+
+	// A line in the table is always valid
+	while (fa->table[b] != NO_LINE) {
+		if (fa->lines[fa->table[b]].tag == tag) {
+			return fa->table[b];
+		}
+		b = (b + 1) & fa->mask;
+	}
+	return NO_LINE;
+}
+
+
+
+/**
+ * Returns the line a miss would fill: the lowest empty line, or the least
+ * recently used one.
+ */
+int faVictim(const fa_index_t *fa) {
+	if (fa->next_free < fa->num_free) {
+		return fa->free_lines[fa->next_free];
+	}
+	return fa->tail;
+}
+
+
+
+/**
+ * Writes the recency order back into the lru fields, so the lines can be
+ * saved or scanned like any other set.
+ *
+ * @param fa The index
+ */
+void faSync(const fa_index_t *fa) {
+	unsigned int rank = 0;
+	int line, i;
+
+	for (line = fa->head; line != NO_LINE; line = fa->next[line]) {
+		fa->lines[line].lru = rank++;
+	}
+	for (i = fa->next_free; i < fa->num_free; i++) {
+		fa->lines[fa->free_lines[i]].lru = rank++;
+	}
+}
+
+
+
+/**
+ * Frees the index.
+ *
+ * @param fa The index
+ */
+void faFree(fa_index_t *fa) {
+	free(fa->prev);
+	free(fa->next);
+	free(fa->free_lines);
+	free(fa->table);
+	free(fa);
+}
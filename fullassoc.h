@@ -0,0 +1,38 @@
+/*
+ * fullassoc.h - O(1) lookup and LRU for a cache with a single set
+ */
+
+#ifndef CSIM_FULLASSOC_H
+#define CSIM_FULLASSOC_H
+
+#include "cache.h"
+
+typedef struct fa_index fa_index_t;
+
+/*
+ * faCreate - Index the lines of a one-set cache as they stand, taking the
+ *     recency order from their lru fields. The lines must outlive it.
+ *     Returns NULL when out of memory.
+ */
+fa_index_t *faCreate(Line *lines, int lines_per_set);
+
+/*
+ * faAccess - Look tag up, and on a miss fill the first empty line or the
+ *     least recently used one. Only valid and tag are kept up to date in
+ *     lines; lru is left stale until faSync.
+ */
+enum access_outcome faAccess(fa_index_t *fa, mem_addr tag);
+
+/* faLookup - The line holding tag, or -1 */
+int faLookup(const fa_index_t *fa, mem_addr tag);
+
+/* faVictim - The line a miss would fill */
+int faVictim(const fa_index_t *fa);
+
+/* faSync - Write the recency order back into the lru fields */
+void faSync(const fa_index_t *fa);
+
+/* Free the index */
+void faFree(fa_index_t *fa);
+
+#endif /* CSIM_FULLASSOC_H */
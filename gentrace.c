@@ -0,0 +1,337 @@
+/*
+ * gentrace.c
+ *
+ * Synthetic trace generator for benchmarking the simulator. Writes traces in
+ * the same valgrind/lackey format as the files in traces/, following one of
+ * several access patterns over a configurable footprint.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <getopt.h>
+#include <unistd.h>
+
+// Where generated data starts, roughly where the traces in traces/ live
+#define BASE_ADDRESS 0x00600000UL
+
+// Granularity of random and pointer-chasing accesses
+#define SLOT_SIZE 64
+
+// Access patterns that can be generated
+enum pattern {
+	PATTERN_SEQUENTIAL,
+	PATTERN_STRIDED,
+	PATTERN_UNIFORM,
+	PATTERN_ZIPF,
+	PATTERN_CHASE,
+	PATTERN_TILE
+};
+
+static const char *pattern_names[] = {
+	"seq", "stride", "uniform", "zipf", "chase", "tile"
+};
+
+// xorshift64* state, so traces are identical for a given seed everywhere
+static uint64_t rng_state;
+
+
+
+/**
+ * Prints out a reminder of how to run the program.
+ *
+ * @param executable_name String containing the name of the executable.
+ */
+void usage(char *executable_name) {
+	printf("Usage: %s -p <pattern> [-f <footprint>] [-n <length>]"
+			" [-r <seed>] [-S <stride>] [-T <tile>] [-z <alpha>]"
+			" [-o <outfile>]\n", executable_name);
+	printf("Patterns: seq stride uniform zipf chase tile\n");
+}
+
+
+
+/**
+ * Returns the next pseudo random number.
+ */
+static uint64_t nextRandom(void) {
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+
+
+/**
+ * Returns a pseudo random number in [0, 1).
+ */
+static double nextUniform(void) {
+	return (nextRandom() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+
+
+/**
+ * Picks an operation for random patterns: mostly loads, some stores and
+ * modifies, like a typical lackey trace.
+ */
+static char randomOperation(void) {
+	uint64_t r = nextRandom() % 10;
+	if (r < 7) {
+		return 'L';
+	} else if (r < 9) {
+		return 'S';
+	}
+	return 'M';
+}
+
+
+
+/**
+ * Writes one data access line.
+ *
+ * @param out Output stream
+ * @param operation 'L', 'S' or 'M'
+ * @param address Memory location of the access
+ * @param size Number of bytes accessed
+ */
+static void emit(FILE *out, char operation, unsigned long address, int size) {
+	fprintf(out, " %c %08lx,%d\n", operation, address, size);
+}
+
+
+
+/**
+ * Builds the cumulative distribution of a Zipf law over n items.
+ *
+ * @param n Number of items
+ * @param alpha Skew of the distribution
+ * @return Array of n cumulative probabilities, owned by the caller
+ */
+static double *zipfTable(unsigned long n, double alpha) {
+	double *cdf = malloc(n * sizeof(double));
+	double sum = 0;
+	unsigned long i;
+
+	if (cdf == NULL) {
+		printf("Error allocating zipf table\n");
+		exit(1);
+	}
+	for (i = 0; i < n; i++) {
+		sum += 1.0 / pow((double)(i + 1), alpha);
+		cdf[i] = sum;
+	}
+	for (i = 0; i < n; i++) {
+		cdf[i] /= sum;
+	}
+	return cdf;
+}
+
+
+
+/**
+ * Draws an item from a Zipf distribution by binary search of its CDF.
+ *
+ * @param cdf Table built by zipfTable
+ * @param n Number of items
+ */
+static unsigned long zipfDraw(const double *cdf, unsigned long n) {
+	double u = nextUniform();
+	unsigned long lo = 0, hi = n - 1;
+	while (lo < hi) {
+		unsigned long mid = lo + (hi - lo) / 2;
+		if (cdf[mid] < u) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+
+
+/**
+ * Builds a random single-cycle permutation (Sattolo's algorithm), so that a
+ * pointer chase visits every slot before repeating.
+ *
+ * @param n Number of slots
+ * @return Array mapping each slot to the next one, owned by the caller
+ */
+static unsigned long *chaseTable(unsigned long n) {
+	unsigned long *next = malloc(n * sizeof(unsigned long));
+	unsigned long i;
+
+	if (next == NULL) {
+		printf("Error allocating chase table\n");
+		exit(1);
+	}
+	for (i = 0; i < n; i++) {
+		next[i] = i;
+	}
+	for (i = n - 1; i > 0; i--) {
+		unsigned long j = nextRandom() % i;
+		unsigned long tmp = next[i];
+		next[i] = next[j];
+		next[j] = tmp;
+	}
+	return next;
+}
+
+
+
+/**
+ * Main function of program. Parses options and writes the trace.
+ *
+ * @param argc Number of arguments from the command line
+ * @param argv Arguments from the command line
+ */
+int main(int argc, char *argv[]) {
+	int pattern = -1;
+	unsigned long footprint = 1UL << 20;
+	unsigned long length = 1000000;
+	unsigned long stride = 64;
+	unsigned long tile = 8;
+	double alpha = 0.99;
+	char *out_filename = NULL;
+	FILE *out = stdout;
+	unsigned long i;
+	int c, p;
+
+	rng_state = 1;
+
+	while ((c = getopt(argc, argv, "hp:f:n:r:S:T:z:o:")) != -1) {
+		switch (c) {
+			case 'p':
+				for (p = 0; p <= PATTERN_TILE; p++) {
+					if (!strcmp(optarg, pattern_names[p])) {
+						pattern = p;
+					}
+				}
+				break;
+			case 'f':
+				footprint = strtoul(optarg, NULL, 10);
+				break;
+			case 'n':
+				length = strtoul(optarg, NULL, 10);
+				break;
+			case 'r':
+				// zero is a fixed point of xorshift
+				rng_state = strtoull(optarg, NULL, 10) | 1;
+				break;
+			case 'S':
+				stride = strtoul(optarg, NULL, 10);
+				break;
+			case 'T':
+				tile = strtoul(optarg, NULL, 10);
+				break;
+			case 'z':
+				alpha = strtod(optarg, NULL);
+				break;
+			case 'o':
+				out_filename = optarg;
+				break;
+			default:
+				usage(argv[0]);
+				exit(1);
+		}
+	}
+
+	if (pattern < 0 || footprint < SLOT_SIZE || stride == 0 || tile == 0) {
+		usage(argv[0]);
+		exit(1);
+	}
+
+	if (out_filename != NULL) {
+		out = fopen(out_filename, "w");
+		if (out == NULL) {
+			printf("Error opening file");
+			exit(1);
+		}
+	}
+
+	unsigned long slots = footprint / SLOT_SIZE;
+
+	switch (pattern) {
+		case PATTERN_SEQUENTIAL:
+			for (i = 0; i < length; i++) {
+				emit(out, 'L', BASE_ADDRESS + (i * 8) % footprint, 8);
+			}
+			break;
+
+		case PATTERN_STRIDED:
+			for (i = 0; i < length; i++) {
+				emit(out, 'L', BASE_ADDRESS + (i * stride) % footprint, 8);
+			}
+			break;
+
+		case PATTERN_UNIFORM:
+			for (i = 0; i < length; i++) {
+				unsigned long offset = nextRandom() % (footprint / 8) * 8;
+				emit(out, randomOperation(), BASE_ADDRESS + offset, 8);
+			}
+			break;
+
+		case PATTERN_ZIPF: {
+			// Popular slots are scattered so that rank isn't locality
+			double *cdf = zipfTable(slots, alpha);
+			unsigned long *scatter = chaseTable(slots);
+			for (i = 0; i < length; i++) {
+				unsigned long slot = scatter[zipfDraw(cdf, slots)];
+				emit(out, randomOperation(),
+						BASE_ADDRESS + slot * SLOT_SIZE, 8);
+			}
+			free(scatter);
+			free(cdf);
+			break;
+		}
+
+		case PATTERN_CHASE: {
+			unsigned long *next = chaseTable(slots);
+			unsigned long slot = 0;
+			for (i = 0; i < length; i++) {
+				emit(out, 'L', BASE_ADDRESS + slot * SLOT_SIZE, 8);
+				slot = next[slot];
+			}
+			free(next);
+			break;
+		}
+
+		case PATTERN_TILE: {
+			// Blocked transpose of two square int matrices sharing the
+			// footprint, repeated until the length is reached
+			unsigned long n = (unsigned long)sqrt(footprint / 8.0);
+			unsigned long b_base = BASE_ADDRESS + n * n * 4;
+			unsigned long ii, jj, r, col;
+			if (n == 0) {
+				n = 1;
+			}
+			i = 0;
+			while (i < length) {
+				for (ii = 0; ii < n && i < length; ii += tile) {
+					for (jj = 0; jj < n && i < length; jj += tile) {
+						for (r = ii; r < ii + tile && r < n && i < length;
+								r++) {
+							for (col = jj; col < jj + tile && col < n
+									&& i < length; col++) {
+								emit(out, 'L',
+										BASE_ADDRESS + (r * n + col) * 4, 4);
+								emit(out, 'S', b_base + (col * n + r) * 4, 4);
+								i += 2;
+							}
+						}
+					}
+				}
+			}
+			break;
+		}
+	}
+
+	if (out != stdout) {
+		fclose(out);
+	}
+	return 0;
+}
@@ -0,0 +1,154 @@
+/*
+ * latency.c
+ *
+ * Turns hits and misses into cycles. Every reference pays the hit latency
+ * and a miss also pays the miss penalty and the memory latency, which is
+ * what the average memory access time is made of.
+ *
+ * The run time is kept as a clock. Without an MLP window a miss stalls the
+ * clock until it returns. With one, up to mlp misses are in flight at once
+ * and later references keep issuing behind them; a miss that finds the
+ * window full waits for the oldest to return. Every miss takes as long as
+ * any other, so misses return in the order they were issued and the
+ * window is a ring of completion times.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "latency.h"
+
+struct latency {
+	latency_config_t config;
+	unsigned long long now;        /* cycle the next reference issues */
+	unsigned long long last_done;  /* cycle the newest miss returns */
+	unsigned long long total;      /* latency summed over references */
+	unsigned long references;
+	unsigned long long *in_flight; /* completion times, oldest at head */
+	int head, count;
+};
+
+
+
+/**
+ * Creates the model with nothing in flight.
+ *
+ * @param config Latencies and the MLP window
+ * @return The model
+ */
+latency_t *latencyCreate(const latency_config_t *config) {
+	latency_t *lat = calloc(1, sizeof(latency_t));
+	if (lat == NULL) {
+		printf("Error allocating latency model\n");
+		exit(1);
+	}
+	lat->config = *config;
+	if (config->mlp > 0) {
+		lat->in_flight = calloc(config->mlp, sizeof(unsigned long long));
+		if (lat->in_flight == NULL) {
+			printf("Error allocating latency model\n");
+			exit(1);
+		}
+	}
+	return lat;
+}
+
+
+
+/**
+ * Accounts for one reference.
+ *
+ * @param lat The model
+ * @param hit Whether the reference hit in the cache
+ * @param dependent Whether it needs the data of every earlier miss
+ */
+void latencyAccess(latency_t *lat, int hit, int dependent) {
+	int miss_latency = lat->config.miss_penalty + lat->config.memory;
+
+	if (dependent && lat->now < lat->last_done) {
+		lat->now = lat->last_done;
+	}
+	lat->references++;
+	lat->total += lat->config.hit;
+	lat->now += lat->config.hit;
+	if (hit) {
+		return;
+	}
+	lat->total += miss_latency;
+
+	// Blocking: the clock waits for the miss
+	if (lat->in_flight == NULL) {
+		lat->now += miss_latency;
+		lat->last_done = lat->now;
+		return;
+	}
+
+	// Retiring what returned, then waiting for a slot if none is free
+	while (lat->count > 0 && lat->in_flight[lat->head] <= lat->now) {
+		lat->head = (lat->head + 1) % lat->config.mlp;
+		lat->count--;
+	}
+	if (lat->count == lat->config.mlp) {
+		lat->now = lat->in_flight[lat->head];
+		lat->head = (lat->head + 1) % lat->config.mlp;
+		lat->count--;
+	}
+	lat->last_done = lat->now + miss_latency;
+	lat->in_flight[(lat->head + lat->count) % lat->config.mlp] =
+		lat->last_done;
+	lat->count++;
+}
+
+
+
+/**
+ * Adds cycles to the clock and to the reference they are part of.
+ *
+ * @param lat The model
+ * @param cycles Cycles to add
+ */
+void latencyStall(latency_t *lat, int cycles) {
+	lat->now += cycles;
+	lat->total += cycles;
+}
+
+
+
+/**
+ * Returns the cycle the next reference issues at.
+ */
+unsigned long long latencyNow(const latency_t *lat) {
+	return lat->now;
+}
+
+
+
+/**
+ * Prints the cycle counts. The run ends when its last miss returns.
+ *
+ * @param lat The model
+ */
+void latencyReport(const latency_t *lat) {
+	unsigned long long cycles = lat->now > lat->last_done ? lat->now
+		: lat->last_done;
+
+	printf("Latency: references:%lu cycles:%llu AMAT:%.2f",
+			lat->references, cycles, lat->references
+			? (double)lat->total / lat->references : 0);
+	if (lat->in_flight != NULL) {
+		printf(" mlp:%d overlap:%.2f", lat->config.mlp,
+				cycles ? (double)lat->total / cycles : 0);
+	}
+	printf("\n");
+}
+
+
+
+/**
+ * Frees the model.
+ *
+ * @param lat The model
+ */
+void latencyFree(latency_t *lat) {
+	free(lat->in_flight);
+	free(lat);
+}
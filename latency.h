@@ -0,0 +1,43 @@
+/*
+ * latency.h - Cycle accounting for the accesses of a run (--latency)
+ */
+
+#ifndef CSIM_LATENCY_H
+#define CSIM_LATENCY_H
+
+// Cycles each step of an access takes
+typedef struct latency_config {
+	int hit;           /* looking up the cache, hit or miss */
+	int miss_penalty;  /* getting a miss to memory and back */
+	int memory;        /* memory itself */
+	int tlb;           /* an L2 TLB lookup after an L1 TLB miss */
+	int mlp;           /* misses that can be in flight, 0 = one at a time */
+} latency_config_t;
+
+typedef struct latency latency_t;
+
+/* latencyCreate - Start a run at cycle 0 */
+latency_t *latencyCreate(const latency_config_t *config);
+
+/*
+ * latencyAccess - Account for one reference that hit or missed. A
+ *     dependent reference waits for every miss before it to return.
+ */
+void latencyAccess(latency_t *lat, int hit, int dependent);
+
+/* latencyStall - Add cycles that nothing can overlap */
+void latencyStall(latency_t *lat, int cycles);
+
+/* latencyNow - Cycle the next reference issues at */
+unsigned long long latencyNow(const latency_t *lat);
+
+/*
+ * latencyReport - Print the references, total cycles and the average
+ *     memory access time.
+ */
+void latencyReport(const latency_t *lat);
+
+/* Free the model */
+void latencyFree(latency_t *lat);
+
+#endif /* CSIM_LATENCY_H */
@@ -0,0 +1,305 @@
+/*
+ * libcsim.c
+ *
+ * Handle-based wrapper around the cache model in cache.c, built as
+ * libcsim.a and libcsim.so. Everything is compiled with hidden visibility,
+ * so the shared library exports only the csim* functions of libcsim.h.
+ * Running out of memory is returned to the caller, never fatal.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "cache.h"
+#include "checkpoint.h"
+#include "libcsim.h"
+
+// Records handed to the cache model per call by csimAccessN
+#define CSIM_BATCH_SIZE 256
+
+// CSIM_* bits for each access_outcome
+static const unsigned char csim_outcomes[ACCESS_NUM_OUTCOMES] = {
+	[ACCESS_NONE] = 0,
+	[ACCESS_HIT] = CSIM_HIT,
+	[ACCESS_MISS] = CSIM_MISS,
+	[ACCESS_EVICTION] = CSIM_MISS | CSIM_EVICTION
+};
+
+// Everything one simulated cache needs
+struct csim {
+	Set *cache;
+	int set_bits;
+	int block_bits;
+	int lines_per_set;
+	unsigned long accesses;
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long evictions;
+};
+
+
+
+/**
+ * Allocates an unconfigured simulator.
+ *
+ * @return The new simulator, or NULL when out of memory
+ */
+csim_t *csimCreate(void) {
+	return calloc(1, sizeof(csim_t));
+}
+
+
+
+/**
+ * Gives the simulator a new geometry, discarding any previous state.
+ *
+ * @param sim The simulator
+ * @param set_bits Number of set index bits
+ * @param lines_per_set Number of lines per cache set
+ * @param block_bits Number of block offset bits
+ * @return 0 on success, -1 for an invalid geometry or when out of memory,
+ *   leaving the simulator as it was
+ */
+int csimConfigure(csim_t *sim, int set_bits, int lines_per_set,
+		int block_bits) {
+	Set *cache;
+
+	if (set_bits < 0 || set_bits > 30 || block_bits < 0
+			|| set_bits + block_bits > 63 || lines_per_set <= 0) {
+		return -1;
+	}
+
+	// Building the new cache before giving up the old one
+	if (set_bits >= SPARSE_SET_BITS) {
+		cache = createSparseCache(1 << set_bits, lines_per_set);
+	} else {
+		cache = createCache(1 << set_bits, lines_per_set);
+	}
+	if (cache == NULL) {
+		return -1;
+	}
+	if (set_bits == 0 && cacheIndex(cache, lines_per_set)) {
+		freeCache(cache, 1);
+		return -1;
+	}
+
+	if (sim->cache != NULL) {
+		freeCache(sim->cache, 1 << sim->set_bits);
+	}
+	sim->cache = cache;
+	sim->set_bits = set_bits;
+	sim->block_bits = block_bits;
+	sim->lines_per_set = lines_per_set;
+	sim->accesses = 0;
+	sim->hits = sim->misses = sim->evictions = 0;
+	return 0;
+}
+
+
+
+/**
+ * Invalidates every line and zeroes the counters.
+ *
+ * @param sim The simulator
+ * @return 0 on success, -1 when out of memory, leaving the simulator as it
+ *   was
+ */
+int csimReset(csim_t *sim) {
+	if (sim->cache == NULL) {
+		return 0;
+	}
+	return csimConfigure(sim, sim->set_bits, sim->lines_per_set,
+			sim->block_bits);
+}
+
+
+
+/**
+ * Frees the simulator.
+ *
+ * @param sim The simulator, may be NULL
+ */
+void csimDestroy(csim_t *sim) {
+	if (sim == NULL) {
+		return;
+	}
+	if (sim->cache != NULL) {
+		freeCache(sim->cache, 1 << sim->set_bits);
+	}
+	free(sim);
+}
+
+
+
+/**
+ * Simulates up to CSIM_BATCH_SIZE records with the cache model, whose int
+ * counters start from zero for each call so they can't overflow, and adds
+ * them to the simulator's.
+ *
+ * @param sim The simulator, which must be configured
+ * @param records The records
+ * @param count Number of records, at most CSIM_BATCH_SIZE
+ * @param outcomes Receives the outcome of each record
+ * @return Number of records simulated, fewer than count when out of memory
+ */
+static size_t accessBatch(csim_t *sim, const trace_record_t *records,
+		size_t count, unsigned char *outcomes) {
+	int hit_count = 0, miss_count = 0, eviction_count = 0;
+	size_t simulated = cacheAccessBatch(sim->cache, sim->set_bits,
+			sim->block_bits, sim->lines_per_set, records, count, 0, outcomes,
+			&hit_count, &miss_count, &eviction_count);
+
+	sim->hits += hit_count;
+	sim->misses += miss_count;
+	sim->evictions += eviction_count;
+	return simulated;
+}
+
+
+
+/**
+ * Simulates one access.
+ *
+ * @param sim The simulator
+ * @param operation 'L', 'S' or 'M'
+ * @param address Memory location of the access
+ * @param size Number of bytes accessed
+ * @return CSIM_* outcome bits, 0 for other operations, or CSIM_ERROR when
+ *   out of memory
+ */
+unsigned int csimAccess(csim_t *sim, char operation, unsigned long address,
+		int size) {
+	trace_record_t record = { address, size, operation };
+	unsigned char outcome;
+
+	if (sim->cache == NULL || (operation != 'L' && operation != 'S'
+				&& operation != 'M')) {
+		return 0;
+	}
+
+	if (accessBatch(sim, &record, 1, &outcome) == 0) {
+		return CSIM_ERROR;
+	}
+	sim->accesses++;
+	return csim_outcomes[outcome];
+}
+
+
+
+/**
+ * Simulates an array of accesses in order, a batch at a time.
+ *
+ * @param sim The simulator
+ * @param records The accesses
+ * @param count Number of records
+ * @param outcomes Receives the outcome of each record, may be NULL
+ * @return 0 on success, -1 when out of memory
+ */
+int csimAccessN(csim_t *sim, const csim_record_t *records, size_t count,
+		unsigned char *outcomes) {
+	trace_record_t batch[CSIM_BATCH_SIZE];
+	unsigned char batch_outcomes[CSIM_BATCH_SIZE];
+	size_t done, i, n, simulated;
+
+	for (done = 0; done < count; done += n) {
+		n = count - done < CSIM_BATCH_SIZE ? count - done : CSIM_BATCH_SIZE;
+		if (sim->cache == NULL) {
+			if (outcomes != NULL) {
+				memset(outcomes + done, 0, n);
+			}
+			continue;
+		}
+		for (i = 0; i < n; i++) {
+			batch[i].address = records[done + i].address;
+			batch[i].size = records[done + i].size;
+			batch[i].operation = records[done + i].operation;
+		}
+		simulated = accessBatch(sim, batch, n, batch_outcomes);
+		for (i = 0; i < simulated; i++) {
+			if (batch_outcomes[i] != ACCESS_NONE) {
+				sim->accesses++;
+			}
+			if (outcomes != NULL) {
+				outcomes[done + i] = csim_outcomes[batch_outcomes[i]];
+			}
+		}
+
+		// The rest of the records are left unsimulated
+		if (simulated < n) {
+			if (outcomes != NULL) {
+				memset(outcomes + done + simulated, CSIM_ERROR,
+						count - done - simulated);
+			}
+			return -1;
+		}
+	}
+	return 0;
+}
+
+
+
+/**
+ * Saves the complete cache state and counters.
+ *
+ * @param sim The simulator
+ * @param path File to write
+ * @return 0 on success, -1 on error
+ */
+int csimSave(const csim_t *sim, const char *path) {
+	checkpoint_t info = { sim->set_bits, sim->lines_per_set, sim->block_bits,
+		sim->hits, sim->misses, sim->evictions, sim->accesses,
+		0 };
+
+	if (sim->cache == NULL) {
+		return -1;
+	}
+	return saveCheckpoint(path, sim->cache, &info);
+}
+
+
+
+/**
+ * Replaces the simulator's state with a checkpoint.
+ *
+ * @param sim The simulator
+ * @param path File to map
+ * @return 0 on success, -1 on error
+ */
+int csimRestore(csim_t *sim, const char *path) {
+	checkpoint_t info;
+	Set *cache = restoreCheckpoint(path, &info);
+
+	if (cache == NULL) {
+		return -1;
+	}
+	if (info.set_bits == 0 && cacheIndex(cache, info.lines_per_set)) {
+		freeCache(cache, 1);
+		return -1;
+	}
+	if (sim->cache != NULL) {
+		freeCache(sim->cache, 1 << sim->set_bits);
+	}
+	sim->cache = cache;
+	sim->set_bits = info.set_bits;
+	sim->lines_per_set = info.lines_per_set;
+	sim->block_bits = info.block_bits;
+	sim->accesses = info.records;
+	sim->hits = info.hits;
+	sim->misses = info.misses;
+	sim->evictions = info.evictions;
+	return 0;
+}
+
+
+
+/**
+ * Copies the counters out of the simulator.
+ *
+ * @param sim The simulator
+ * @param stats Receives the counters
+ */
+void csimGetStats(const csim_t *sim, csim_stats_t *stats) {
+	stats->accesses = sim->accesses;
+	stats->hits = sim->hits;
+	stats->misses = sim->misses;
+	stats->evictions = sim->evictions;
+}
@@ -0,0 +1,104 @@
+/*
+ * libcsim.h - Embeddable cache simulator
+ *
+ * Lets other programs feed accesses straight into the cache model instead
+ * of writing trace files for csim:
+ *
+ *   csim_t *sim = csimCreate();
+ *   csimConfigure(sim, 5, 1, 5);
+ *   outcome = csimAccess(sim, 'L', address, 4);
+ *   csimGetStats(sim, &stats);
+ *   csimDestroy(sim);
+ */
+
+#ifndef LIBCSIM_H
+#define LIBCSIM_H
+
+#include <stddef.h>
+
+// The library exports these functions and nothing else
+#if defined(__GNUC__)
+#define CSIM_API __attribute__((visibility("default")))
+#else
+#define CSIM_API
+#endif
+
+// Outcome bits returned for each access. A modify also hits on its store.
+// CSIM_ERROR is returned alone when the cache ran out of memory.
+#define CSIM_HIT      0x1
+#define CSIM_MISS     0x2
+#define CSIM_EVICTION 0x4
+#define CSIM_ERROR    0x8
+
+typedef struct csim csim_t;
+
+// One access, for csimAccessN
+typedef struct csim_record {
+	unsigned long address;
+	int size;
+	char operation; /* 'L', 'S' or 'M' */
+} csim_record_t;
+
+// Counters since the last csimConfigure or csimReset
+typedef struct csim_stats {
+	unsigned long accesses;
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long evictions;
+} csim_stats_t;
+
+/* Allocate an unconfigured simulator, or return NULL when out of memory */
+CSIM_API csim_t *csimCreate(void);
+
+/*
+ * csimConfigure - Give the simulator 2^set_bits sets of lines_per_set lines
+ *     of 2^block_bits bytes, all invalid. Returns 0, or -1 if the geometry
+ *     is invalid or memory runs out, leaving the simulator unchanged.
+ */
+CSIM_API int csimConfigure(csim_t *sim, int set_bits, int lines_per_set,
+		int block_bits);
+
+/*
+ * csimReset - Invalidate every line and zero the counters. Returns 0, or -1
+ *     when memory runs out, leaving the simulator unchanged.
+ */
+CSIM_API int csimReset(csim_t *sim);
+
+/* Free the simulator */
+CSIM_API void csimDestroy(csim_t *sim);
+
+/*
+ * csimAccess - Simulate one 'L', 'S' or 'M' access and return its CSIM_*
+ *     outcome bits, or 0 for any other operation. Returns CSIM_ERROR, and
+ *     simulates nothing, if the lines of the access's set can't be
+ *     allocated.
+ */
+CSIM_API unsigned int csimAccess(csim_t *sim, char operation,
+		unsigned long address, int size);
+
+/*
+ * csimAccessN - Simulate count accesses in order. Outcome bits are stored
+ *     in outcomes[i] when outcomes is not NULL. Returns 0, or -1 when
+ *     memory runs out; the access that needed it and the ones after it
+ *     aren't simulated, and get CSIM_ERROR as their outcome.
+ */
+CSIM_API int csimAccessN(csim_t *sim, const csim_record_t *records,
+		size_t count, unsigned char *outcomes);
+
+/*
+ * csimSave - Write the complete cache state and counters to path.
+ *     Returns 0, or -1 on error.
+ */
+CSIM_API int csimSave(const csim_t *sim, const char *path);
+
+/*
+ * csimRestore - Replace the simulator's geometry, state and counters with
+ *     the checkpoint at path. The file is mapped, not read, so restoring is
+ *     instant. Returns 0, or -1 on error, leaving the simulator unchanged.
+ */
+CSIM_API int csimRestore(csim_t *sim, const char *path);
+
+/* Copy the counters into stats */
+CSIM_API void csimGetStats(const csim_t *sim, csim_stats_t *stats);
+
+#endif /* LIBCSIM_H */
@@ -0,0 +1,218 @@
+/*
+ * lockstep.c
+ *
+ * Simulates up to LOCKSTEP_LANES small caches over the same trace at once,
+ * for sweeping cache organizations. Each cache is a lane of a GCC vector,
+ * with its own set bits, block bits and lines per set. A record's set and
+ * tag are decoded for every lane with one vector shift and mask, the lines
+ * of its set are compared in every lane together, and the counts are kept
+ * as vectors. Only the loads and stores of lines are done lane by lane,
+ * since each lane's sets are an array of its own; without gather and
+ * scatter instructions the compiler does them one element at a time, and
+ * only for the lanes in use. Every lane is compared for as many ways as
+ * the widest has, so callers group caches with the same lines per set.
+ *
+ * Each line holds its tag and the time it was last used, 0 for an empty
+ * line. A miss fills the first empty line of the set, or else the one used
+ * longest ago. That is the line cacheAccessBatch fills, whose LRU ranks are
+ * just these times renumbered, so every lane counts what a run of the
+ * cache model on its own would.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "lockstep.h"
+
+// One value per lane, and the all ones or all zeros lanes a compare gives
+typedef uint64_t lane_vec __attribute__((vector_size(LOCKSTEP_LANES
+				* sizeof(uint64_t))));
+
+// Lanes of a where mask is set, and of b elsewhere. A macro, since passing
+// vectors wider than the target's registers to a function changes the ABI.
+#define BLEND(mask, a, b) (((mask) & (a)) | (~(mask) & (b)))
+
+struct lockstep {
+	int count;                         /* lanes in use */
+	int max_ways;                      /* most lines per set of any lane */
+	lane_vec block_bits;
+	lane_vec tag_shift;                /* set bits plus block bits */
+	lane_vec set_mask;
+	lane_vec ways;                     /* lines per set */
+	uint64_t *tags[LOCKSTEP_LANES];    /* line i of set s at s * ways + i */
+	uint64_t *used[LOCKSTEP_LANES];    /* time of last use, 0 = empty */
+	uint64_t now;                      /* accesses so far */
+	lane_vec hits, misses, evictions;
+};
+
+
+
+/**
+ * Creates empty caches. Lanes past count get a one line cache whose counts
+ * are never read.
+ *
+ * @param configs Organization of each cache
+ * @param count Number of caches, 1 to LOCKSTEP_LANES
+ * @return The caches, or NULL for an organization a lane can't hold
+ */
+lockstep_t *lockstepCreate(const lockstep_config_t *configs, int count) {
+	lockstep_t *ls;
+	int l;
+
+	if (count < 1 || count > LOCKSTEP_LANES) {
+		return NULL;
+	}
+	for (l = 0; l < count; l++) {
+		if (configs[l].set_bits < 0 || configs[l].block_bits < 0
+				|| configs[l].set_bits + configs[l].block_bits >= 64
+				|| configs[l].lines_per_set < 1
+				|| configs[l].lines_per_set > LOCKSTEP_MAX_WAYS) {
+			return NULL;
+		}
+	}
+
+	ls = calloc(1, sizeof(lockstep_t));
+	if (ls == NULL) {
+		printf("Error allocating lockstep caches\n");
+		exit(1);
+	}
+	ls->count = count;
+	ls->max_ways = 1;
+	for (l = 0; l < LOCKSTEP_LANES; l++) {
+		lockstep_config_t config = { 0, 1, 0 };
+		size_t lines;
+
+		if (l < count) {
+			config = configs[l];
+		}
+		if (config.lines_per_set > ls->max_ways) {
+			ls->max_ways = config.lines_per_set;
+		}
+		ls->block_bits[l] = config.block_bits;
+		ls->tag_shift[l] = config.set_bits + config.block_bits;
+		ls->set_mask[l] = (1UL << config.set_bits) - 1;
+		ls->ways[l] = config.lines_per_set;
+
+		lines = ((size_t)1 << config.set_bits) * config.lines_per_set;
+		ls->tags[l] = calloc(lines, sizeof(uint64_t));
+		ls->used[l] = calloc(lines, sizeof(uint64_t));
+		if (ls->tags[l] == NULL || ls->used[l] == NULL) {
+			printf("Error allocating lockstep caches\n");
+			exit(1);
+		}
+	}
+	return ls;
+}
+
+
+
+/**
+ * Simulates a buffer of records in every cache.
+ *
+ * @param ls The caches
+ * @param records The records; other operations than L, S and M are ignored
+ * @param count Number of records
+ */
+void lockstepAccessBatch(lockstep_t *ls, const trace_record_t *records,
+		size_t count) {
+	lane_vec hits = ls->hits, misses = ls->misses;
+	lane_vec evictions = ls->evictions;
+	size_t r;
+	int l, w;
+
+	for (r = 0; r < count; r++) {
+		const trace_record_t *rec = &records[r];
+
+		if (rec->operation != 'L' && rec->operation != 'S'
+				&& rec->operation != 'M') {
+			continue;
+		}
+		ls->now++;
+
+		// Decoding the address for every lane at once
+		lane_vec address = (lane_vec){ 0 } + rec->address;
+		lane_vec set = (address >> ls->block_bits) & ls->set_mask;
+		lane_vec tag = address >> ls->tag_shift;
+		lane_vec first = set * ls->ways;
+
+		// Comparing way w of the set in every lane, and keeping the
+		// oldest line; an empty one is older than any. Lanes with fewer
+		// ways, and empty lines, are given a tag that can't match and
+		// lanes past the last way a time that is never the oldest, so
+		// the vector compares need no masks.
+		lane_vec found = { 0 }, hit_way = { 0 }, victim = { 0 };
+		lane_vec oldest = ~(lane_vec){ 0 }, no_tag = ~tag;
+		for (w = 0; w < ls->max_ways; w++) {
+			lane_vec line_tag = no_tag, line_used = ~(lane_vec){ 0 };
+			for (l = 0; l < ls->count; l++) {
+				if (w < (int)ls->ways[l]) {
+					line_used[l] = ls->used[l][first[l] + w];
+					if (line_used[l] != 0) {
+						line_tag[l] = ls->tags[l][first[l] + w];
+					}
+				}
+			}
+			lane_vec match = (lane_vec)(line_tag == tag);
+			lane_vec older = (lane_vec)(line_used < oldest);
+			found |= match;
+			hit_way |= match & (unsigned long)w;
+			victim = BLEND(older, (lane_vec){ 0 } + (unsigned long)w,
+					victim);
+			oldest = BLEND(older, line_used, oldest);
+		}
+
+		// Compare results are all ones, so subtracting them counts one
+		hits -= found;
+		misses -= ~found;
+		evictions -= ~found & (lane_vec)(oldest != 0);
+		if (rec->operation == 'M') {
+			hits += 1;
+		}
+
+		// The hit line, or the filled one, is now the most recently used
+		lane_vec way = first + BLEND(found, hit_way, victim);
+		for (l = 0; l < ls->count; l++) {
+			ls->tags[l][way[l]] = tag[l];
+			ls->used[l][way[l]] = ls->now;
+		}
+	}
+
+	ls->hits = hits;
+	ls->misses = misses;
+	ls->evictions = evictions;
+}
+
+
+
+/**
+ * Reads the counts of one cache.
+ *
+ * @param ls The caches
+ * @param lane Which cache, in the order given to lockstepCreate
+ * @param hit_count Receives the number of hits
+ * @param miss_count Receives the number of misses
+ * @param eviction_count Receives the number of evictions
+ */
+void lockstepCounts(const lockstep_t *ls, int lane, int *hit_count,
+		int *miss_count, int *eviction_count) {
+	*hit_count = (int)ls->hits[lane];
+	*miss_count = (int)ls->misses[lane];
+	*eviction_count = (int)ls->evictions[lane];
+}
+
+
+
+/**
+ * Frees every cache.
+ *
+ * @param ls The caches
+ */
+void lockstepFree(lockstep_t *ls) {
+	int l;
+
+	for (l = 0; l < LOCKSTEP_LANES; l++) {
+		free(ls->tags[l]);
+		free(ls->used[l]);
+	}
+	free(ls);
+}
@@ -0,0 +1,46 @@
+/*
+ * lockstep.h - Several small caches simulated side by side on one trace
+ */
+
+#ifndef CSIM_LOCKSTEP_H
+#define CSIM_LOCKSTEP_H
+
+#include "cache.h"
+
+// Caches one group steps through a record together, one per vector lane
+#define LOCKSTEP_LANES 8
+
+// Most lines per set a lane can have
+#define LOCKSTEP_MAX_WAYS 4
+
+// Organization of one lane's cache
+typedef struct lockstep_config {
+	int set_bits;
+	int lines_per_set;
+	int block_bits;
+} lockstep_config_t;
+
+typedef struct lockstep lockstep_t;
+
+/*
+ * lockstepCreate - Create count empty caches, at most LOCKSTEP_LANES. Returns
+ *     NULL if a cache has more than LOCKSTEP_MAX_WAYS lines per set, or
+ *     set_bits + block_bits of 64 or more.
+ */
+lockstep_t *lockstepCreate(const lockstep_config_t *configs, int count);
+
+/*
+ * lockstepAccessBatch - Simulate a buffer of records in every cache.
+ *     Each cache ends up with the counts cacheAccessBatch would give it.
+ */
+void lockstepAccessBatch(lockstep_t *ls, const trace_record_t *records,
+		size_t count);
+
+/* Counts of one cache since lockstepCreate */
+void lockstepCounts(const lockstep_t *ls, int lane, int *hit_count,
+		int *miss_count, int *eviction_count);
+
+/* Free every cache */
+void lockstepFree(lockstep_t *ls);
+
+#endif /* CSIM_LOCKSTEP_H */
@@ -0,0 +1,252 @@
+/*
+ * packed.c
+ *
+ * The same LRU cache as the Line arrays in cache.c, in a fraction of the
+ * memory, so that more caches fit in the host's caches at once. A set
+ * keeps a bitmask of valid lines, the LRU rank of every line in a field
+ * of ceil(log2(E)) bits, and its tags as 16 bit offsets from a 32 bit
+ * per-set base. A tag that can't be reached from the base first tries
+ * moving the base to the smallest tag in the set; if the set's tags still
+ * span more than 16 bits, or the smallest is above 32 bits, the set is
+ * widened to full tags kept in a side pool. No tag is ever truncated, so
+ * results are bit-exact.
+ *
+ * Ranks follow the same rules as Line.lru: valid lines rank 0 up from the
+ * most recent, and empty lines rank after them in line order.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "packed.h"
+
+// Largest offset from a set's base
+#define DELTA_MAX 0xffff
+
+// Per set state; wide sets keep their tags in the pool at base
+typedef struct packed_set {
+	uint16_t valid;   /* bit per line */
+	uint16_t wide;    /* tags are in the pool */
+	uint32_t base;    /* smallest tag reachable, or the pool block */
+	uint64_t ranks;   /* rank_bits per line, line 0 lowest */
+} packed_set_t;
+
+struct packed_cache {
+	int ways, rank_bits;
+	uint64_t rank_mask;
+	size_t num_sets;
+	packed_set_t *sets;
+	uint16_t *deltas;    /* ways per set */
+	uint64_t *pool;      /* ways full tags per wide set */
+	size_t pool_used, pool_size;
+};
+
+
+
+/**
+ * Creates an empty cache.
+ *
+ * @param num_sets Number of sets
+ * @param lines_per_set Number of lines per set, at most PACKED_MAX_WAYS
+ * @return The cache, to be released with packedFree, or NULL when out of
+ *   memory
+ */
+packed_cache_t *packedCreate(int num_sets, int lines_per_set) {
+	packed_cache_t *pc = calloc(1, sizeof(packed_cache_t));
+	size_t s;
+	int w;
+
+	if (pc == NULL) {
+		return NULL;
+	}
+	pc->ways = lines_per_set;
+	pc->rank_bits = 1;
+	while ((1 << pc->rank_bits) < lines_per_set) {
+		pc->rank_bits++;
+	}
+	pc->rank_mask = (1UL << pc->rank_bits) - 1;
+	pc->num_sets = num_sets;
+	pc->sets = malloc(num_sets * sizeof(packed_set_t));
+	pc->deltas = calloc((size_t)num_sets * lines_per_set, sizeof(uint16_t));
+	if (pc->sets == NULL || pc->deltas == NULL) {
+		packedFree(pc);
+		return NULL;
+	}
+
+	// Empty lines ranked in line order
+	packed_set_t empty = { 0, 0, 0, 0 };
+	for (w = 0; w < lines_per_set; w++) {
+		empty.ranks |= (uint64_t)w << (w * pc->rank_bits);
+	}
+	for (s = 0; s < pc->num_sets; s++) {
+		pc->sets[s] = empty;
+	}
+	return pc;
+}
+
+
+
+/**
+ * Returns the tag of a valid line.
+ */
+static uint64_t tagOf(const packed_cache_t *pc, const packed_set_t *set,
+		size_t s, int way) {
+	if (set->wide) {
+		return pc->pool[(size_t)set->base * pc->ways + way];
+	}
+	return (uint64_t)set->base + pc->deltas[s * pc->ways + way];
+}
+
+
+
+/**
+ * Moves a set's tags into the pool.
+ */
+static void widenSet(packed_cache_t *pc, packed_set_t *set, size_t s) {
+	int w;
+
+	if (pc->pool_used == pc->pool_size) {
+		pc->pool_size = pc->pool_size ? 2 * pc->pool_size : 64;
+		pc->pool = realloc(pc->pool,
+				pc->pool_size * pc->ways * sizeof(uint64_t));
+		if (pc->pool == NULL) {
+			printf("Error allocating cache\n");
+			exit(1);
+		}
+	}
+	for (w = 0; w < pc->ways; w++) {
+		pc->pool[pc->pool_used * pc->ways + w] =
+			(set->valid >> w) & 1 ? tagOf(pc, set, s, w) : 0;
+	}
+	set->base = (uint32_t)pc->pool_used++;
+	set->wide = 1;
+}
+
+
+
+/**
+ * Stores a tag in a line, which must already be marked valid.
+ */
+static void storeTag(packed_cache_t *pc, packed_set_t *set, size_t s,
+		int way, uint64_t tag) {
+	uint16_t *deltas = &pc->deltas[s * pc->ways];
+	uint64_t lo = tag, hi = tag, t;
+	int w;
+
+	if (!set->wide) {
+		if (set->valid == (1u << way) && tag <= UINT32_MAX) {
+			set->base = (uint32_t)tag;
+		}
+		if (tag >= set->base && tag - set->base <= DELTA_MAX) {
+			deltas[way] = (uint16_t)(tag - set->base);
+			return;
+		}
+
+		// Rebasing at the smallest tag, if the span allows
+		for (w = 0; w < pc->ways; w++) {
+			if (w != way && (set->valid >> w) & 1) {
+				t = set->base + deltas[w];
+				lo = t < lo ? t : lo;
+				hi = t > hi ? t : hi;
+			}
+		}
+		if (hi - lo <= DELTA_MAX && lo <= UINT32_MAX) {
+			for (w = 0; w < pc->ways; w++) {
+				if (w != way && (set->valid >> w) & 1) {
+					deltas[w] = (uint16_t)(set->base + deltas[w] - lo);
+				}
+			}
+			set->base = (uint32_t)lo;
+			deltas[way] = (uint16_t)(tag - lo);
+			return;
+		}
+		widenSet(pc, set, s);
+	}
+	pc->pool[(size_t)set->base * pc->ways + way] = tag;
+}
+
+
+
+/**
+ * Looks a tag up in a set, filling it on a miss, and updates the ranks.
+ *
+ * @param pc The cache
+ * @param s The set
+ * @param tag The tag being accessed
+ * @return ACCESS_HIT, ACCESS_MISS or ACCESS_EVICTION
+ */
+enum access_outcome packedAccess(packed_cache_t *pc, size_t s, uint64_t tag) {
+	packed_set_t *set = &pc->sets[s];
+	int rank_bits = pc->rank_bits;
+	uint64_t last = pc->ways - 1, prev, rank;
+	enum access_outcome outcome = ACCESS_HIT;
+	int w, way = -1;
+
+	// A tag out of reach of the base can't be in a narrow set
+	if (set->wide || (tag >= set->base && tag - set->base <= DELTA_MAX)) {
+		for (w = 0; w < pc->ways; w++) {
+			if ((set->valid >> w) & 1 && tagOf(pc, set, s, w) == tag) {
+				way = w;
+				break;
+			}
+		}
+	}
+
+	// Filling the lowest empty line, or the least recently used
+	if (way < 0) {
+		unsigned int empty = ~set->valid & ((1u << pc->ways) - 1);
+		if (empty) {
+			way = __builtin_ctz(empty);
+			outcome = ACCESS_MISS;
+		} else {
+			for (w = 0; w < pc->ways; w++) {
+				if (((set->ranks >> (w * rank_bits)) & pc->rank_mask)
+						== last) {
+					way = w;
+				}
+			}
+			outcome = ACCESS_EVICTION;
+		}
+		set->valid |= 1u << way;
+		storeTag(pc, set, s, way, tag);
+	}
+
+	// Most recent goes to 0, the valid lines ahead of it move back
+	prev = (set->ranks >> (way * rank_bits)) & pc->rank_mask;
+	for (w = 0; w < pc->ways; w++) {
+		if (!((set->valid >> w) & 1)) {
+			continue;
+		}
+		rank = (set->ranks >> (w * rank_bits)) & pc->rank_mask;
+		if (rank <= prev) {
+			set->ranks &= ~(pc->rank_mask << (w * rank_bits));
+			set->ranks |= (rank == prev ? 0 : rank + 1) << (w * rank_bits);
+		}
+	}
+	return outcome;
+}
+
+
+
+/**
+ * Returns the bytes the cache's state takes.
+ */
+size_t packedBytes(const packed_cache_t *pc) {
+	return pc->num_sets * (sizeof(packed_set_t)
+			+ pc->ways * sizeof(uint16_t))
+		+ pc->pool_used * pc->ways * sizeof(uint64_t);
+}
+
+
+
+/**
+ * Frees the cache.
+ *
+ * @param pc The cache
+ */
+void packedFree(packed_cache_t *pc) {
+	free(pc->sets);
+	free(pc->deltas);
+	free(pc->pool);
+	free(pc);
+}
@@ -0,0 +1,35 @@
+/*
+ * packed.h - A compact encoding of cache state for sweeps
+ */
+
+#ifndef CSIM_PACKED_H
+#define CSIM_PACKED_H
+
+#include <stdint.h>
+#include "cache.h"
+
+// Most lines per set the packed encoding handles
+#define PACKED_MAX_WAYS 16
+
+typedef struct packed_cache packed_cache_t;
+
+/*
+ * packedCreate - Create an empty cache, lines_per_set at most 16. Returns
+ *     NULL when out of memory.
+ */
+packed_cache_t *packedCreate(int num_sets, int lines_per_set);
+
+/*
+ * packedAccess - Look tag up in a set and on a miss fill the first empty
+ *     line or the least recently used one, exactly as the Line arrays do.
+ */
+enum access_outcome packedAccess(packed_cache_t *pc, size_t set,
+		uint64_t tag);
+
+/* Bytes the state takes */
+size_t packedBytes(const packed_cache_t *pc);
+
+/* Free the cache */
+void packedFree(packed_cache_t *pc);
+
+#endif /* CSIM_PACKED_H */
@@ -0,0 +1,648 @@
+/*
+ * parse.c
+ *
+ * A validating parser for trace lines (" L 00602260,4"), and a reader that
+ * feeds it either serially from a stream or in parallel from a mapped file.
+ *
+ * The serial reader pulls the trace into a large buffer with fread and
+ * finds lines with memchr, so malformed lines are found while parsing
+ * rather than by a separate pass, and resynchronising is just moving on to
+ * the next line.
+ *
+ * The parallel reader maps the trace, splits it into chunks at line
+ * boundaries and lets worker threads decode chunks into binary records,
+ * while the simulation consumes the chunks strictly in trace order. A
+ * worker can run at most PARSE_SLOTS_PER_THREAD chunks per thread ahead of
+ * the simulation, so memory stays bounded.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "parse.h"
+
+// Serial read buffer, large enough that pipes are drained in big reads
+// instead of one page at a time. Longer lines are malformed.
+#define READER_BUFFER_SIZE (1 << 20)
+
+// Bytes of trace per chunk
+#define PARSE_CHUNK_SIZE (4 << 20)
+
+// Chunks buffered per worker thread
+#define PARSE_SLOTS_PER_THREAD 2
+
+// Records a slot starts with room for, grown as needed
+#define PARSE_SLOT_RECORDS (PARSE_CHUNK_SIZE / 16)
+
+// Longest address and size fields that fit their types
+#define MAX_ADDRESS_DIGITS 16
+#define MAX_SIZE_DIGITS 9
+#define MAX_THREAD_DIGITS 5
+
+// Value of each hex digit plus one, 0 for other characters
+static const unsigned char hex_digit[256] = {
+	['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+	['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+	['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+	['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16
+};
+
+// Decoded records of one chunk. A malformed line is kept in order as a
+// record with operation 0, its byte offset as the address and its line
+// within the chunk as the size.
+typedef struct parse_slot {
+	trace_record_t *records;
+	size_t count, capacity;
+	unsigned long lines;  /* lines in the chunk */
+	size_t chunk;         /* which chunk the records belong to */
+	int ready;            /* parsed and not yet consumed */
+} parse_slot_t;
+
+typedef struct parallel_parser {
+	const char *data;
+	size_t size;
+	size_t num_chunks;
+
+	parse_slot_t *slots;
+	int num_slots;
+	pthread_t *threads;
+	int num_threads;
+
+	// Consumer side
+	size_t consume_chunk;
+	size_t pos;
+	int holding;
+	unsigned long line_base;  /* lines before the consumed chunk */
+
+	// Shared, under lock
+	size_t next_chunk;
+	int closing;
+	pthread_mutex_t lock;
+	pthread_cond_t ready_cond, free_cond;
+} parallel_parser_t;
+
+struct trace_reader {
+	parallel_parser_t *parallel;
+
+	// Serial reading: bytes [start, end) of buffer are unread
+	FILE *fp;
+	char *buffer;
+	size_t start, end;
+	int eof;
+	int overlong;          /* dropping the rest of a line too long to hold */
+	unsigned long line;    /* lines consumed */
+	unsigned long offset;  /* trace offset of buffer[start] */
+};
+
+
+
+/**
+ * Parses one trace line.
+ *
+ * @param p Start of the line
+ * @param eol End of the line, where its newline is or would be
+ * @param rec Receives the record
+ * @return PARSE_RECORD, PARSE_BLANK or PARSE_MALFORMED
+ */
+enum parse_result parseLine(const char *p, const char *eol,
+		trace_record_t *rec) {
+	unsigned long address = 0;
+	int size = 0, thread = 0;
+	const char *digits;
+
+	while (p < eol && (*p == ' ' || *p == '\t' || *p == '\r')) {
+		p++;
+	}
+	if (p == eol) {
+		return PARSE_BLANK;
+	}
+
+	// Operation, a single letter followed by white space
+	if (*p != 'L' && *p != 'S' && *p != 'M' && *p != 'I') {
+		return PARSE_MALFORMED;
+	}
+	rec->operation = *p++;
+	if (p == eol || (*p != ' ' && *p != '\t')) {
+		return PARSE_MALFORMED;
+	}
+	while (p < eol && (*p == ' ' || *p == '\t')) {
+		p++;
+	}
+
+	// Address in hex, optionally 0x prefixed
+	if (eol - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')
+			&& hex_digit[(unsigned char)p[2]]) {
+		p += 2;
+	}
+	digits = p;
+	while (p < eol && hex_digit[(unsigned char)*p]) {
+		address = (address << 4) | (hex_digit[(unsigned char)*p] - 1);
+		p++;
+	}
+	if (p == digits || p - digits > MAX_ADDRESS_DIGITS || p == eol
+			|| *p != ',') {
+		return PARSE_MALFORMED;
+	}
+	p++;
+
+	// Size in decimal, at least one byte
+	digits = p;
+	while (p < eol && *p >= '0' && *p <= '9') {
+		size = size * 10 + (*p - '0');
+		p++;
+		if (p - digits > MAX_SIZE_DIGITS) {
+			return PARSE_MALFORMED;
+		}
+	}
+	if (size == 0) {
+		return PARSE_MALFORMED;
+	}
+
+	// Then, in merged multicore traces, the thread in decimal
+	while (p < eol && (*p == ' ' || *p == '\t')) {
+		p++;
+	}
+	digits = p;
+	while (p < eol && *p >= '0' && *p <= '9') {
+		thread = thread * 10 + (*p - '0');
+		p++;
+		if (p - digits > MAX_THREAD_DIGITS) {
+			return PARSE_MALFORMED;
+		}
+	}
+
+	// Nothing but white space after it
+	while (p < eol && (*p == ' ' || *p == '\t' || *p == '\r')) {
+		p++;
+	}
+	if (p != eol || thread > USHRT_MAX) {
+		return PARSE_MALFORMED;
+	}
+
+	rec->address = address;
+	rec->size = size;
+	rec->thread = thread;
+	return PARSE_RECORD;
+}
+
+
+
+/**
+ * Returns where chunk k starts: just after the first newline at or after
+ * its nominal start, so every line belongs to exactly one chunk.
+ */
+static size_t chunkStart(const parallel_parser_t *parser, size_t k) {
+	if (k == 0) {
+		return 0;
+	}
+	if (k >= parser->num_chunks) {
+		return parser->size;
+	}
+	size_t from = k * (size_t)PARSE_CHUNK_SIZE - 1;
+	const char *nl = memchr(parser->data + from, '\n', parser->size - from);
+	return nl == NULL ? parser->size : (size_t)(nl - parser->data) + 1;
+}
+
+
+
+/**
+ * Decodes one chunk into a slot, keeping malformed lines as markers.
+ */
+static void parseChunk(parallel_parser_t *parser, size_t k,
+		parse_slot_t *slot) {
+	const char *p = parser->data + chunkStart(parser, k);
+	const char *end = parser->data + chunkStart(parser, k + 1);
+
+	slot->count = 0;
+	slot->lines = 0;
+	while (p < end) {
+		const char *eol = memchr(p, '\n', end - p);
+		if (eol == NULL) {
+			eol = end;
+		}
+		if (slot->count == slot->capacity) {
+			slot->capacity *= 2;
+			slot->records = realloc(slot->records,
+					slot->capacity * sizeof(trace_record_t));
+			if (slot->records == NULL) {
+				printf("Error allocating parser buffers\n");
+				exit(1);
+			}
+		}
+
+		trace_record_t *rec = &slot->records[slot->count];
+		enum parse_result r = parseLine(p, eol, rec);
+		if (r == PARSE_RECORD) {
+			slot->count++;
+		} else if (r == PARSE_MALFORMED) {
+			rec->operation = 0;
+			rec->address = p - parser->data;
+			rec->size = slot->lines;
+			slot->count++;
+		}
+		slot->lines++;
+		p = eol + 1;
+	}
+}
+
+
+
+/**
+ * Worker thread: parses chunks until none are left.
+ */
+static void *parseWorker(void *arg) {
+	parallel_parser_t *parser = arg;
+
+	pthread_mutex_lock(&parser->lock);
+	for (;;) {
+		// Wait until the slot for the next chunk has been consumed
+		while (!parser->closing && parser->next_chunk < parser->num_chunks
+				&& parser->next_chunk >= parser->consume_chunk
+					+ parser->num_slots) {
+			pthread_cond_wait(&parser->free_cond, &parser->lock);
+		}
+		if (parser->closing || parser->next_chunk >= parser->num_chunks) {
+			break;
+		}
+		size_t k = parser->next_chunk++;
+		parse_slot_t *slot = &parser->slots[k % parser->num_slots];
+		pthread_mutex_unlock(&parser->lock);
+
+		parseChunk(parser, k, slot);
+
+		pthread_mutex_lock(&parser->lock);
+		slot->chunk = k;
+		slot->ready = 1;
+		pthread_cond_broadcast(&parser->ready_cond);
+	}
+	pthread_mutex_unlock(&parser->lock);
+	return NULL;
+}
+
+
+
+/**
+ * Maps a trace and starts the parsing threads.
+ *
+ * @param path The trace file
+ * @param threads Number of parsing threads
+ * @return The parser, or NULL if the file can't be mapped
+ */
+static parallel_parser_t *parallelOpen(const char *path, int threads) {
+	struct stat st;
+	int i;
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+		close(fd);
+		return NULL;
+	}
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		return NULL;
+	}
+	posix_madvise(data, st.st_size, POSIX_MADV_SEQUENTIAL);
+
+	parallel_parser_t *parser = calloc(1, sizeof(parallel_parser_t));
+	if (parser == NULL) {
+		printf("Error allocating parser\n");
+		exit(1);
+	}
+	parser->data = data;
+	parser->size = st.st_size;
+	parser->num_chunks = (parser->size + PARSE_CHUNK_SIZE - 1)
+		/ PARSE_CHUNK_SIZE;
+	parser->num_threads = threads;
+	parser->num_slots = threads * PARSE_SLOTS_PER_THREAD;
+	parser->slots = calloc(parser->num_slots, sizeof(parse_slot_t));
+	parser->threads = calloc(threads, sizeof(pthread_t));
+	if (parser->slots == NULL || parser->threads == NULL) {
+		printf("Error allocating parser buffers\n");
+		exit(1);
+	}
+	for (i = 0; i < parser->num_slots; i++) {
+		parser->slots[i].capacity = PARSE_SLOT_RECORDS;
+		parser->slots[i].records = malloc(PARSE_SLOT_RECORDS
+				* sizeof(trace_record_t));
+		if (parser->slots[i].records == NULL) {
+			printf("Error allocating parser buffers\n");
+			exit(1);
+		}
+	}
+
+	pthread_mutex_init(&parser->lock, NULL);
+	pthread_cond_init(&parser->ready_cond, NULL);
+	pthread_cond_init(&parser->free_cond, NULL);
+	for (i = 0; i < threads; i++) {
+		pthread_create(&parser->threads[i], NULL, parseWorker, parser);
+	}
+	return parser;
+}
+
+
+
+/**
+ * Fetches the next record or malformed line in trace order.
+ *
+ * @param parser The parser
+ * @param rec Receives the record
+ * @param where Receives the position of a malformed line
+ * @return PARSE_RECORD, PARSE_MALFORMED or PARSE_END
+ */
+static enum parse_result parallelNext(parallel_parser_t *parser,
+		trace_record_t *rec, trace_position_t *where) {
+	for (;;) {
+		if (parser->holding) {
+			parse_slot_t *slot =
+				&parser->slots[parser->consume_chunk % parser->num_slots];
+			if (parser->pos < slot->count) {
+				*rec = slot->records[parser->pos++];
+				if (rec->operation != 0) {
+					return PARSE_RECORD;
+				}
+				where->line = parser->line_base + rec->size + 1;
+				where->offset = rec->address;
+				return PARSE_MALFORMED;
+			}
+
+			// Hand the slot back to the workers
+			parser->line_base += slot->lines;
+			pthread_mutex_lock(&parser->lock);
+			slot->ready = 0;
+			parser->consume_chunk++;
+			pthread_cond_broadcast(&parser->free_cond);
+			pthread_mutex_unlock(&parser->lock);
+			parser->holding = 0;
+			parser->pos = 0;
+		}
+
+		if (parser->consume_chunk >= parser->num_chunks) {
+			return PARSE_END;
+		}
+
+		parse_slot_t *slot =
+			&parser->slots[parser->consume_chunk % parser->num_slots];
+		pthread_mutex_lock(&parser->lock);
+		while (!(slot->ready && slot->chunk == parser->consume_chunk)) {
+			pthread_cond_wait(&parser->ready_cond, &parser->lock);
+		}
+		pthread_mutex_unlock(&parser->lock);
+		parser->holding = 1;
+	}
+}
+
+
+
+/**
+ * Stops the threads and releases everything.
+ *
+ * @param parser The parser
+ */
+static void parallelClose(parallel_parser_t *parser) {
+	int i;
+
+	pthread_mutex_lock(&parser->lock);
+	parser->closing = 1;
+	pthread_cond_broadcast(&parser->free_cond);
+	pthread_mutex_unlock(&parser->lock);
+	for (i = 0; i < parser->num_threads; i++) {
+		pthread_join(parser->threads[i], NULL);
+	}
+
+	for (i = 0; i < parser->num_slots; i++) {
+		free(parser->slots[i].records);
+	}
+	free(parser->slots);
+	free(parser->threads);
+	pthread_mutex_destroy(&parser->lock);
+	pthread_cond_destroy(&parser->ready_cond);
+	pthread_cond_destroy(&parser->free_cond);
+	munmap((void *)parser->data, parser->size);
+	free(parser);
+}
+
+
+
+/**
+ * Creates a reader, parallel if it can be.
+ *
+ * @param fp The trace stream
+ * @param path The trace file to map, or NULL to read fp
+ * @param threads Number of parsing threads, 1 or less to read serially
+ * @param offset Where fp is in the trace
+ * @return The reader
+ */
+trace_reader_t *readerOpen(FILE *fp, const char *path, int threads,
+		unsigned long offset) {
+	trace_reader_t *reader = calloc(1, sizeof(trace_reader_t));
+	if (reader == NULL) {
+		printf("Error allocating trace reader\n");
+		exit(1);
+	}
+	reader->fp = fp;
+	reader->offset = offset;
+	if (threads > 1 && path != NULL) {
+		reader->parallel = parallelOpen(path, threads);
+	}
+	if (reader->parallel == NULL) {
+		reader->buffer = malloc(READER_BUFFER_SIZE);
+		if (reader->buffer == NULL) {
+			printf("Error allocating trace reader\n");
+			exit(1);
+		}
+	}
+	return reader;
+}
+
+
+
+/**
+ * Moves the unread bytes to the front of the buffer and reads more after
+ * them.
+ */
+static void readerFill(trace_reader_t *reader) {
+	size_t unread = reader->end - reader->start;
+
+	memmove(reader->buffer, reader->buffer + reader->start, unread);
+	reader->start = 0;
+	reader->end = unread;
+	size_t n = fread(reader->buffer + unread, 1, READER_BUFFER_SIZE - unread,
+			reader->fp);
+	reader->end += n;
+	if (n == 0) {
+		reader->eof = 1;
+	}
+}
+
+
+
+/**
+ * Finds the next whole line in the serial buffer, reading more as needed.
+ *
+ * @param reader The reader
+ * @param eol Receives the end of the line
+ * @return Start of the line, or NULL at the end of the trace
+ */
+static const char *readerLine(trace_reader_t *reader, const char **eol) {
+	for (;;) {
+		const char *p = reader->buffer + reader->start;
+		const char *nl = memchr(p, '\n', reader->end - reader->start);
+
+		// Resynchronising after a line longer than the buffer
+		if (reader->overlong) {
+			size_t dropped = nl != NULL ? (size_t)(nl - p) + 1
+				: reader->end - reader->start;
+			reader->start += dropped;
+			reader->offset += dropped;
+			if (nl != NULL) {
+				reader->overlong = 0;
+			} else if (reader->eof) {
+				return NULL;
+			} else {
+				readerFill(reader);
+			}
+			continue;
+		}
+
+		if (nl != NULL) {
+			*eol = nl;
+			return p;
+		}
+		if (reader->eof) {
+			// Last line with no newline after it. If reading failed it is
+			// only the part before the error, which isn't a line at all.
+			if (reader->start == reader->end || ferror(reader->fp)) {
+				return NULL;
+			}
+			*eol = reader->buffer + reader->end;
+			return p;
+		}
+		if (reader->start == 0 && reader->end == READER_BUFFER_SIZE) {
+			*eol = reader->buffer + reader->end;
+			reader->overlong = 1;
+			return p;
+		}
+		readerFill(reader);
+	}
+}
+
+
+
+/**
+ * Marks the line returned by readerLine as consumed.
+ */
+static void readerConsume(trace_reader_t *reader, const char *eol) {
+	size_t length = eol - (reader->buffer + reader->start);
+	if (!reader->overlong && reader->start + length < reader->end) {
+		length++;  // the newline
+	}
+	reader->start += length;
+	reader->offset += length;
+	reader->line++;
+}
+
+
+
+/**
+ * Reads the next record, skipping blank lines.
+ *
+ * @param reader The reader
+ * @param rec Receives the record
+ * @param where Receives the position of a malformed line
+ * @return PARSE_RECORD, PARSE_MALFORMED or PARSE_END
+ */
+enum parse_result readerNext(trace_reader_t *reader, trace_record_t *rec,
+		trace_position_t *where) {
+	const char *p, *eol;
+
+	if (reader->parallel != NULL) {
+		return parallelNext(reader->parallel, rec, where);
+	}
+	while ((p = readerLine(reader, &eol)) != NULL) {
+		unsigned long offset = reader->offset;
+		enum parse_result r = reader->overlong ? PARSE_MALFORMED
+			: parseLine(p, eol, rec);
+		readerConsume(reader, eol);
+		if (r == PARSE_MALFORMED) {
+			where->line = reader->line;
+			where->offset = offset;
+		}
+		if (r != PARSE_BLANK) {
+			return r;
+		}
+	}
+	return PARSE_END;
+}
+
+
+
+/**
+ * Fast-forwards past records by looking for line ends only. Every line
+ * that isn't blank counts as a record.
+ *
+ * @param reader The reader
+ * @param count Number of records to skip
+ * @return Number of records actually skipped
+ */
+unsigned long readerSkip(trace_reader_t *reader, unsigned long count) {
+	unsigned long skipped = 0;
+	trace_record_t rec;
+	trace_position_t where;
+	const char *p, *eol;
+
+	if (reader->parallel != NULL) {
+		while (skipped < count
+				&& parallelNext(reader->parallel, &rec, &where) != PARSE_END) {
+			skipped++;
+		}
+		return skipped;
+	}
+	while (skipped < count && (p = readerLine(reader, &eol)) != NULL) {
+		const char *q = p;
+		while (q < eol && (*q == ' ' || *q == '\t' || *q == '\r')) {
+			q++;
+		}
+		if (q < eol) {
+			skipped++;
+		}
+		readerConsume(reader, eol);
+	}
+	return skipped;
+}
+
+
+
+/**
+ * Returns the trace offset of the next unread line.
+ *
+ * @param reader The reader
+ * @return The offset, or -1 for a parallel reader
+ */
+long readerOffset(const trace_reader_t *reader) {
+	return reader->parallel != NULL ? -1 : (long)reader->offset;
+}
+
+
+
+/**
+ * Stops any parsing threads and frees the reader.
+ *
+ * @param reader The reader
+ */
+void readerClose(trace_reader_t *reader) {
+	if (reader->parallel != NULL) {
+		parallelClose(reader->parallel);
+	}
+	free(reader->buffer);
+	free(reader);
+}
@@ -0,0 +1,61 @@
+/*
+ * parse.h - Validating trace parser, serial or in parallel chunks
+ */
+
+#ifndef CSIM_PARSE_H
+#define CSIM_PARSE_H
+
+#include <stdio.h>
+#include "cache.h"
+
+// Where a line starts in the trace
+typedef struct trace_position {
+	unsigned long line;    /* counted from 1 */
+	unsigned long offset;  /* bytes from the start of the trace */
+} trace_position_t;
+
+// Result of parsing one line, or of reading the next record
+enum parse_result {
+	PARSE_RECORD,    /* the record was filled in */
+	PARSE_BLANK,     /* the line was empty */
+	PARSE_MALFORMED, /* the line is not "<L|S|M|I> <hex>,<size> [thread]" */
+	PARSE_END        /* no more lines */
+};
+
+/*
+ * parseLine - Parse the line [p, eol), without its newline.
+ */
+enum parse_result parseLine(const char *p, const char *eol,
+		trace_record_t *rec);
+
+typedef struct trace_reader trace_reader_t;
+
+/*
+ * readerOpen - Read records from fp, which is at byte offset in the trace.
+ *     If threads > 1 and path names a plain file, the file is instead
+ *     mapped and parsed ahead by that many threads; fp is then unused.
+ */
+trace_reader_t *readerOpen(FILE *fp, const char *path, int threads,
+		unsigned long offset);
+
+/*
+ * readerNext - Read the next record, skipping blank lines. A malformed
+ *     line returns PARSE_MALFORMED with *where set to its position, and
+ *     the next call resumes at the line after it.
+ */
+enum parse_result readerNext(trace_reader_t *reader, trace_record_t *rec,
+		trace_position_t *where);
+
+/*
+ * readerSkip - Fast-forward past count records without decoding them.
+ *     Returns the number skipped, less than count at the end of the trace.
+ */
+unsigned long readerSkip(trace_reader_t *reader, unsigned long count);
+
+/* Byte offset of the next unread line, or -1 if it isn't known */
+long readerOffset(const trace_reader_t *reader);
+
+/* Stop any parsing threads and free the reader; fp is left open */
+void readerClose(trace_reader_t *reader);
+
+#endif /* CSIM_PARSE_H */
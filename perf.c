@@ -0,0 +1,248 @@
+/*
+ * perf.c - Self-profiling of the simulator (--stats-perf)
+ *
+ * Wall time runs from the first trace record to the last, leaving out
+ * setting up the cache and restoring checkpoints. Per-phase times come from
+ * timing one record in PERF_SAMPLE_INTERVAL with clock_gettime, so the
+ * unsampled records pay only for a branch. On Linux, hardware counters are
+ * read around the simulation with perf_event_open when asked for.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#include "perf.h"
+
+int perf_enabled = 0;
+int perf_sample = 0;
+
+static int use_counters = 0;
+static unsigned int sample_countdown = 1;
+static unsigned long samples = 0;
+static unsigned long records = 0;
+static uint64_t last_mark;
+static uint64_t phase_ns[PERF_NUM_PHASES];
+static uint64_t start_ns, stop_ns;
+
+static const char *phase_names[PERF_NUM_PHASES] = {
+	"parse", "decode", "lookup", "replacement update", "output"
+};
+
+#ifdef __linux__
+// Hardware events, read as a single group led by the first one
+#define PERF_NUM_COUNTERS 4
+static const uint64_t counter_config[PERF_NUM_COUNTERS] = {
+	PERF_COUNT_HW_CPU_CYCLES,
+	PERF_COUNT_HW_INSTRUCTIONS,
+	PERF_COUNT_HW_CACHE_MISSES,
+	PERF_COUNT_HW_BRANCH_MISSES
+};
+static int counter_fds[PERF_NUM_COUNTERS] = { -1, -1, -1, -1 };
+static uint64_t counter_values[PERF_NUM_COUNTERS];
+static int counters_valid = 0;
+#endif
+
+
+
+/**
+ * Returns a monotonic timestamp in nanoseconds.
+ */
+static uint64_t now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+
+
+#ifdef __linux__
+/**
+ * Opens the hardware counter group. Leaves counters_valid at 0 when the
+ * kernel refuses (no PMU, paranoid setting, container).
+ */
+static void openCounters(void) {
+	int i;
+	for (i = 0; i < PERF_NUM_COUNTERS; i++) {
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = counter_config[i];
+		attr.disabled = (i == 0);
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP;
+
+		counter_fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1,
+				i == 0 ? -1 : counter_fds[0], 0);
+		if (counter_fds[i] < 0) {
+			while (i-- > 0) {
+				close(counter_fds[i]);
+				counter_fds[i] = -1;
+			}
+			return;
+		}
+	}
+	counters_valid = 1;
+}
+#endif
+
+
+
+/**
+ * Enables profiling.
+ *
+ * @param hardware_counters Whether to also read perf_event counters
+ */
+void perfEnable(int hardware_counters) {
+	perf_enabled = 1;
+	use_counters = hardware_counters;
+}
+
+
+
+/**
+ * Starts the wall clock and the hardware counters.
+ */
+void perfStart(void) {
+	memset(phase_ns, 0, sizeof(phase_ns));
+	samples = 0;
+	sample_countdown = 1;
+#ifdef __linux__
+	if (use_counters) {
+		openCounters();
+		if (counters_valid) {
+			ioctl(counter_fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+			ioctl(counter_fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+		}
+	}
+#endif
+	start_ns = now();
+}
+
+
+
+/**
+ * Stops the wall clock and the hardware counters.
+ *
+ * @param num_records Number of trace records that were simulated
+ */
+void perfStop(unsigned long num_records) {
+	stop_ns = now();
+	perf_sample = 0;
+	records = num_records;
+#ifdef __linux__
+	if (counters_valid) {
+		uint64_t buf[1 + PERF_NUM_COUNTERS];
+		int i;
+		ioctl(counter_fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+		if (read(counter_fds[0], buf, sizeof(buf)) == sizeof(buf)) {
+			for (i = 0; i < PERF_NUM_COUNTERS; i++) {
+				counter_values[i] = buf[1 + i];
+			}
+		} else {
+			counters_valid = 0;
+		}
+		for (i = 0; i < PERF_NUM_COUNTERS; i++) {
+			close(counter_fds[i]);
+			counter_fds[i] = -1;
+		}
+	}
+#endif
+}
+
+
+
+/**
+ * Decides whether the record about to be parsed is sampled.
+ */
+void perfBeginRecord(void) {
+	if (--sample_countdown == 0) {
+		sample_countdown = PERF_SAMPLE_INTERVAL;
+		perf_sample = 1;
+		samples++;
+		last_mark = now();
+	} else {
+		perf_sample = 0;
+	}
+}
+
+
+
+/**
+ * Tells whether the next record perfBeginRecord sees will be sampled.
+ *
+ * @return 1 if it will, else 0
+ */
+int perfNextSampled(void) {
+	return perf_enabled && sample_countdown == 1;
+}
+
+
+
+/**
+ * Attributes the time since the previous mark to a phase.
+ *
+ * @param phase The phase that just finished
+ */
+void perfMark(enum perf_phase phase) {
+	uint64_t t = now();
+	phase_ns[phase] += t - last_mark;
+	last_mark = t;
+}
+
+
+
+/**
+ * Prints the profile to stderr so stdout stays comparable with csim-ref.
+ */
+void perfReport(void) {
+	double wall = (stop_ns - start_ns) / 1e9;
+	double per_access = records ? (stop_ns - start_ns) / (double)records : 0;
+	double sampled_total = 0;
+	int i;
+
+	fprintf(stderr, "perf: wall time %.6f s, %lu accesses\n", wall, records);
+	fprintf(stderr, "perf: %.0f accesses/sec, %.2f ns/access\n",
+			wall > 0 ? records / wall : 0, per_access);
+
+	for (i = 0; i < PERF_NUM_PHASES; i++) {
+		sampled_total += phase_ns[i];
+	}
+	if (samples > 0) {
+		fprintf(stderr, "perf: phases (sampled 1/%d, %lu samples)\n",
+				PERF_SAMPLE_INTERVAL, samples);
+		for (i = 0; i < PERF_NUM_PHASES; i++) {
+			fprintf(stderr, "perf:   %-20s %8.2f ns/access %5.1f%%\n",
+					phase_names[i], (double)phase_ns[i] / samples,
+					sampled_total > 0 ? 100.0 * phase_ns[i] / sampled_total : 0);
+		}
+	}
+
+	if (use_counters) {
+#ifdef __linux__
+		if (counters_valid) {
+			fprintf(stderr, "perf: cycles %lu instructions %lu IPC %.2f\n",
+					(unsigned long)counter_values[0],
+					(unsigned long)counter_values[1],
+					counter_values[0] ?
+					(double)counter_values[1] / counter_values[0] : 0);
+			fprintf(stderr, "perf: cache-misses %lu branch-misses %lu\n",
+					(unsigned long)counter_values[2],
+					(unsigned long)counter_values[3]);
+		} else {
+			fprintf(stderr, "perf: hardware counters unavailable\n");
+		}
+#else
+		fprintf(stderr, "perf: hardware counters unavailable\n");
+#endif
+	}
+}
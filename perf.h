@@ -0,0 +1,59 @@
+/*
+ * perf.h - Self-profiling of the simulator (--stats-perf)
+ */
+
+#ifndef CSIM_PERF_H
+#define CSIM_PERF_H
+
+// Phases of a trace record that time is attributed to
+enum perf_phase {
+	PERF_PARSE,
+	PERF_DECODE,
+	PERF_LOOKUP,
+	PERF_REPLACEMENT,
+	PERF_OUTPUT,
+	PERF_NUM_PHASES
+};
+
+// One record in this many is timed phase by phase
+#define PERF_SAMPLE_INTERVAL 64
+
+// Set when --stats-perf was given
+extern int perf_enabled;
+
+// Set while the current record is being sampled
+extern int perf_sample;
+
+/* PERF_BEGIN_RECORD - Called before each record is parsed */
+#define PERF_BEGIN_RECORD() \
+	do { if (perf_enabled) perfBeginRecord(); } while (0)
+
+/*
+ * PERF_MARK - Attribute the time since the previous mark to phase. Costs a
+ *     single predictable branch on records that are not sampled.
+ */
+#define PERF_MARK(phase) \
+	do { if (perf_sample) perfMark(phase); } while (0)
+
+/* Enable profiling, optionally with hardware counters */
+void perfEnable(int hardware_counters);
+
+/* Start and stop the wall clock and hardware counters */
+void perfStart(void);
+void perfStop(unsigned long num_records);
+
+/* Decides whether the record about to be parsed is sampled */
+void perfBeginRecord(void);
+
+/*
+ * perfNextSampled - Whether the next record will be sampled, so a driver
+ *     that buffers records can simulate those before it first.
+ */
+int perfNextSampled(void);
+
+void perfMark(enum perf_phase phase);
+
+/* Print the profile to stderr */
+void perfReport(void);
+
+#endif /* CSIM_PERF_H */
@@ -0,0 +1,199 @@
+/*
+ * tlb.c
+ *
+ * An L1 and optional L2 TLB keyed by virtual page number. Each level is a
+ * set-associative cache from cache.c with one page per "block", so it has
+ * the same LRU replacement as the data cache. An L2 miss walks an x86-64
+ * style radix page table: four levels for 4K pages, three for 2M and two
+ * for 1G.
+ *
+ * The page table lives at synthetic addresses above user space, one region
+ * per level. An entry's address is its level's base plus eight bytes per
+ * entry, indexed by every address bit the walk has translated so far, so
+ * neighbouring pages have neighbouring entries as in a real page table.
+ * For 47 bit virtual addresses a level's entries fit in 2^38 bytes, so the
+ * levels stay apart from each other and from the trace's own addresses.
+ * The cache keeps every address bit above the set index in its tags, so
+ * they stay apart in the cache too, whatever its geometry.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "tlb.h"
+
+// Where each level of the page table starts, far above trace addresses
+#define PAGE_TABLE_BASE 0xffff000000000000UL
+#define PAGE_TABLE_LEVEL_SPACING (1UL << 38)
+
+// Virtual address bits each level translates, and the lowest one
+#define BITS_PER_LEVEL 9
+#define TOP_LEVEL_SHIFT 39
+
+// One level of TLB
+typedef struct tlb_level {
+	Set *entries;
+	int set_bits;
+	int ways;
+} tlb_level_t;
+
+struct tlb {
+	tlb_level_t l1, l2;
+	int has_l2;
+	int page_bits;
+	tlb_stats_t stats;
+};
+
+
+
+/**
+ * Returns log2 of a power of two, or -1 for anything else.
+ */
+static int log2Exact(int n) {
+	int bits = 0;
+
+	if (n <= 0 || (n & (n - 1))) {
+		return -1;
+	}
+	while ((1 << bits) < n) {
+		bits++;
+	}
+	return bits;
+}
+
+
+
+/**
+ * Sets up one level of TLB.
+ *
+ * @return 0 on success, -1 for a geometry that isn't a power of two
+ */
+static int createLevel(tlb_level_t *level, int entries, int ways) {
+	int set_bits = log2Exact(entries / (ways > 0 ? ways : 1));
+
+	if (log2Exact(entries) < 0 || log2Exact(ways) < 0 || ways > entries
+			|| set_bits < 0) {
+		return -1;
+	}
+	level->set_bits = set_bits;
+	level->ways = ways;
+	level->entries = createCache(1 << set_bits, ways);
+	if (level->entries == NULL
+			|| (set_bits == 0 && cacheIndex(level->entries, ways))) {
+		printf("Error allocating TLB\n");
+		exit(1);
+	}
+	return 0;
+}
+
+
+
+/**
+ * Creates empty TLBs.
+ *
+ * @param config Entries and ways of each level, and the page size
+ * @return The TLBs, or NULL for an invalid geometry
+ */
+tlb_t *tlbCreate(const tlb_config_t *config) {
+	tlb_t *tlb = calloc(1, sizeof(tlb_t));
+
+	if (tlb == NULL) {
+		printf("Error allocating TLB\n");
+		exit(1);
+	}
+	tlb->page_bits = config->page_bits;
+	if (createLevel(&tlb->l1, config->l1_entries, config->l1_ways)) {
+		free(tlb);
+		return NULL;
+	}
+	if (config->l2_entries > 0) {
+		if (createLevel(&tlb->l2, config->l2_entries, config->l2_ways)) {
+			freeCache(tlb->l1.entries, 1 << tlb->l1.set_bits);
+			free(tlb);
+			return NULL;
+		}
+		tlb->has_l2 = 1;
+	}
+	return tlb;
+}
+
+
+
+/**
+ * Looks up a page number in one level, filling it on a miss.
+ *
+ * @return 1 on a hit, 0 on a miss
+ */
+static int lookupLevel(tlb_level_t *level, mem_addr page) {
+	int hits = 0, misses = 0, evictions = 0;
+
+	cacheOperation(level->entries, level->set_bits, 0, level->ways, 'L',
+			page, 1, 0, &hits, &misses, &evictions);
+	return hits != 0;
+}
+
+
+
+/**
+ * Translates one address.
+ *
+ * @param tlb The TLBs
+ * @param address Virtual address
+ * @param counted Whether to add this lookup to the stats
+ * @param walk Receives the page table entries a walk reads
+ * @return Number of entries in walk, 0 if a TLB hit
+ */
+int tlbTranslate(tlb_t *tlb, mem_addr address, int counted,
+		mem_addr walk[MAX_WALK_LEVELS]) {
+	mem_addr page = address >> tlb->page_bits;
+	int levels = 0, shift;
+
+	if (counted) {
+		tlb->stats.accesses++;
+	}
+	if (lookupLevel(&tlb->l1, page)) {
+		return 0;
+	}
+	if (counted) {
+		tlb->stats.l1_misses++;
+	}
+	if (tlb->has_l2 && lookupLevel(&tlb->l2, page)) {
+		return 0;
+	}
+	if (counted) {
+		tlb->stats.l2_misses++;
+	}
+
+	// Walking down to the level that maps this page size
+	for (shift = TOP_LEVEL_SHIFT; shift >= tlb->page_bits;
+			shift -= BITS_PER_LEVEL) {
+		walk[levels] = PAGE_TABLE_BASE
+			+ (mem_addr)levels * PAGE_TABLE_LEVEL_SPACING
+			+ (address >> shift) * 8;
+		levels++;
+	}
+	return levels;
+}
+
+
+
+/**
+ * Returns the counts since tlbCreate.
+ */
+const tlb_stats_t *tlbStats(const tlb_t *tlb) {
+	return &tlb->stats;
+}
+
+
+
+/**
+ * Frees the TLBs.
+ *
+ * @param tlb The TLBs
+ */
+void tlbFree(tlb_t *tlb) {
+	freeCache(tlb->l1.entries, 1 << tlb->l1.set_bits);
+	if (tlb->has_l2) {
+		freeCache(tlb->l2.entries, 1 << tlb->l2.set_bits);
+	}
+	free(tlb);
+}
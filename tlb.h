@@ -0,0 +1,54 @@
+/*
+ * tlb.h - Two-level TLB and the page table walks behind it
+ */
+
+#ifndef CSIM_TLB_H
+#define CSIM_TLB_H
+
+#include "cache.h"
+
+// Page sizes, as page offset bits
+#define PAGE_BITS_4K 12
+#define PAGE_BITS_2M 21
+#define PAGE_BITS_1G 30
+
+// Most page table entries one walk reads
+#define MAX_WALK_LEVELS 4
+
+// Geometry of the TLBs; an L2 with no entries is left out
+typedef struct tlb_config {
+	int l1_entries, l1_ways;
+	int l2_entries, l2_ways;
+	int page_bits;
+} tlb_config_t;
+
+typedef struct tlb_stats {
+	unsigned long accesses;
+	unsigned long l1_misses;
+	unsigned long l2_misses;  /* also the number of page walks */
+} tlb_stats_t;
+
+typedef struct tlb tlb_t;
+
+/*
+ * tlbCreate - Create empty TLBs. Returns NULL if entries and ways aren't
+ *     powers of two with ways dividing entries.
+ */
+tlb_t *tlbCreate(const tlb_config_t *config);
+
+/*
+ * tlbTranslate - Look up the page of address, filling the TLBs on a miss.
+ *     Only counted lookups are added to the stats. Returns how many page
+ *     table entries a walk had to read, 0 on a hit, and stores their
+ *     addresses in walk.
+ */
+int tlbTranslate(tlb_t *tlb, mem_addr address, int counted,
+		mem_addr walk[MAX_WALK_LEVELS]);
+
+/* Counts since tlbCreate */
+const tlb_stats_t *tlbStats(const tlb_t *tlb);
+
+/* Free the TLBs */
+void tlbFree(tlb_t *tlb);
+
+#endif /* CSIM_TLB_H */
@@ -0,0 +1,793 @@
+/*
+ * tracein.c
+ *
+ * Opens traces for the parser. Plain files are handed to stdio directly.
+ * Streams (stdin, pipes) are read strictly forwards. Traces compressed with
+ * gzip, xz or zstd are recognised by their magic bytes and decompressed on
+ * a separate thread into a ring of large buffers; the parser reads the ring
+ * through an ordinary FILE * made with fopencookie, so it never knows the
+ * difference. zstd traces made of several small frames are decompressed a
+ * batch of frames at a time, one frame per thread; a frame larger than a
+ * ring slot, such as the single frame zstd writes by default, is streamed.
+ *
+ * Each library is optional at build time (HAVE_ZLIB, HAVE_LZMA, HAVE_ZSTD).
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_LZMA
+#include <lzma.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "tracein.h"
+
+// Decompressed data is passed to the parser in this many buffers
+#define RING_SLOTS 8
+#define RING_SLOT_SIZE (1 << 20)
+
+// Compressed data is read in chunks of this size
+#define INPUT_SIZE (1 << 20)
+
+// Longest magic number we look for
+#define MAGIC_MAX 6
+
+// Most zstd frames decompressed at once
+#define ZSTD_THREADS 4
+
+// One open trace
+typedef struct trace_input {
+	int fd;
+	enum trace_format format;
+
+	// Bytes read while detecting the format, replayed before the rest
+	unsigned char prefix[MAGIC_MAX];
+	size_t prefix_len;
+	size_t prefix_pos;
+
+	// Ring of decompressed buffers: the thread fills slot head, the
+	// parser drains slot tail
+	char *slots[RING_SLOTS];
+	size_t slot_len[RING_SLOTS];
+	unsigned int head, tail, count;
+	size_t read_pos;
+	int done, failed, closing;
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty, not_full;
+	pthread_t thread;
+} trace_input_t;
+
+
+
+/**
+ * Reads raw input, replaying the detected prefix first.
+ *
+ * @param in The trace
+ * @param buf Where to put the bytes
+ * @param size Most bytes to read
+ * @return Bytes read, 0 at end of input, -1 on error
+ */
+static ssize_t readInput(trace_input_t *in, void *buf, size_t size) {
+	if (in->prefix_pos < in->prefix_len) {
+		size_t n = in->prefix_len - in->prefix_pos;
+		if (n > size) {
+			n = size;
+		}
+		memcpy(buf, in->prefix + in->prefix_pos, n);
+		in->prefix_pos += n;
+		return n;
+	}
+
+	ssize_t n;
+	do {
+		n = read(in->fd, buf, size);
+	} while (n < 0 && errno == EINTR);
+	return n;
+}
+
+
+
+#if defined(HAVE_ZLIB) || defined(HAVE_LZMA) || defined(HAVE_ZSTD)
+/**
+ * Waits for a free ring slot for the decompression thread to fill.
+ *
+ * @param in The trace
+ * @return The slot's buffer, or NULL if the trace is being closed
+ */
+static char *ringAcquire(trace_input_t *in) {
+	char *slot = NULL;
+
+	pthread_mutex_lock(&in->lock);
+	while (in->count == RING_SLOTS && !in->closing) {
+		pthread_cond_wait(&in->not_full, &in->lock);
+	}
+	if (!in->closing) {
+		slot = in->slots[in->head];
+	}
+	pthread_mutex_unlock(&in->lock);
+	return slot;
+}
+
+
+
+/**
+ * Hands the slot from ringAcquire to the parser.
+ *
+ * @param in The trace
+ * @param len Number of bytes written to it
+ */
+static void ringCommit(trace_input_t *in, size_t len) {
+	if (len == 0) {
+		return;
+	}
+	pthread_mutex_lock(&in->lock);
+	in->slot_len[in->head] = len;
+	in->head = (in->head + 1) % RING_SLOTS;
+	in->count++;
+	pthread_cond_signal(&in->not_empty);
+	pthread_mutex_unlock(&in->lock);
+}
+#endif
+
+
+
+/**
+ * Marks the end of decompressed data.
+ *
+ * @param in The trace
+ * @param failed Whether decompression stopped because of an error
+ */
+static void ringFinish(trace_input_t *in, int failed) {
+	pthread_mutex_lock(&in->lock);
+	in->done = 1;
+	in->failed = failed;
+	pthread_cond_signal(&in->not_empty);
+	pthread_mutex_unlock(&in->lock);
+}
+
+
+
+#ifdef HAVE_ZSTD
+/**
+ * Copies decompressed data into the ring, filling slots completely.
+ *
+ * @param in The trace
+ * @param slot Current slot, updated as slots fill up
+ * @param used Bytes already in the current slot
+ * @param data Bytes to add
+ * @param len Number of bytes
+ * @return 0, or -1 if the trace is being closed
+ */
+static int ringWrite(trace_input_t *in, char **slot, size_t *used,
+		const char *data, size_t len) {
+	while (len > 0) {
+		size_t n = RING_SLOT_SIZE - *used;
+		if (n > len) {
+			n = len;
+		}
+		memcpy(*slot + *used, data, n);
+		*used += n;
+		data += n;
+		len -= n;
+		if (*used == RING_SLOT_SIZE) {
+			ringCommit(in, *used);
+			*used = 0;
+			if ((*slot = ringAcquire(in)) == NULL) {
+				return -1;
+			}
+		}
+	}
+	return 0;
+}
+#endif
+
+
+
+#ifdef HAVE_ZLIB
+/**
+ * Decompresses gzip (or zlib) data, including concatenated members.
+ *
+ * @param in The trace
+ * @return 0 on success, -1 on error
+ */
+static int decodeGzip(trace_input_t *in) {
+	unsigned char *input = malloc(INPUT_SIZE);
+	z_stream zs;
+	int eof = 0, ended = 0, ret, result = -1;
+	char *slot;
+
+	memset(&zs, 0, sizeof(zs));
+	if (input == NULL || inflateInit2(&zs, 15 + 32) != Z_OK) {
+		free(input);
+		return -1;
+	}
+	if ((slot = ringAcquire(in)) == NULL) {
+		goto out;
+	}
+	zs.next_out = (unsigned char *)slot;
+	zs.avail_out = RING_SLOT_SIZE;
+
+	for (;;) {
+		if (zs.avail_in == 0 && !eof) {
+			ssize_t n = readInput(in, input, INPUT_SIZE);
+			if (n < 0) {
+				goto out;
+			}
+			eof = (n == 0);
+			zs.next_in = input;
+			zs.avail_in = n;
+		}
+		if (zs.avail_in == 0 && eof) {
+			break;
+		}
+
+		ret = inflate(&zs, Z_NO_FLUSH);
+		if (ret == Z_STREAM_END) {
+			// Another member may follow
+			ended = 1;
+			inflateReset(&zs);
+		} else if (ret == Z_OK) {
+			ended = 0;
+		} else if (ret != Z_BUF_ERROR) {
+			goto out;
+		}
+
+		if (zs.avail_out == 0) {
+			ringCommit(in, RING_SLOT_SIZE);
+			if ((slot = ringAcquire(in)) == NULL) {
+				goto out;
+			}
+			zs.next_out = (unsigned char *)slot;
+			zs.avail_out = RING_SLOT_SIZE;
+		}
+	}
+
+	ringCommit(in, RING_SLOT_SIZE - zs.avail_out);
+	result = ended ? 0 : -1;
+
+out:
+	inflateEnd(&zs);
+	free(input);
+	return result;
+}
+#endif
+
+
+
+#ifdef HAVE_LZMA
+/**
+ * Decompresses xz data, including concatenated streams.
+ *
+ * @param in The trace
+ * @return 0 on success, -1 on error
+ */
+static int decodeXz(trace_input_t *in) {
+	unsigned char *input = malloc(INPUT_SIZE);
+	lzma_stream strm = LZMA_STREAM_INIT;
+	lzma_action action = LZMA_RUN;
+	lzma_ret ret;
+	int result = -1;
+	char *slot;
+
+	if (input == NULL || lzma_stream_decoder(&strm, UINT64_MAX,
+				LZMA_CONCATENATED) != LZMA_OK) {
+		free(input);
+		return -1;
+	}
+	if ((slot = ringAcquire(in)) == NULL) {
+		goto out;
+	}
+	strm.next_out = (uint8_t *)slot;
+	strm.avail_out = RING_SLOT_SIZE;
+
+	for (;;) {
+		if (strm.avail_in == 0 && action == LZMA_RUN) {
+			ssize_t n = readInput(in, input, INPUT_SIZE);
+			if (n < 0) {
+				goto out;
+			}
+			if (n == 0) {
+				action = LZMA_FINISH;
+			}
+			strm.next_in = input;
+			strm.avail_in = n;
+		}
+
+		ret = lzma_code(&strm, action);
+		if (strm.avail_out == 0 || ret == LZMA_STREAM_END) {
+			ringCommit(in, RING_SLOT_SIZE - strm.avail_out);
+			if (ret == LZMA_STREAM_END) {
+				result = 0;
+				break;
+			}
+			if ((slot = ringAcquire(in)) == NULL) {
+				goto out;
+			}
+			strm.next_out = (uint8_t *)slot;
+			strm.avail_out = RING_SLOT_SIZE;
+		}
+		if (ret != LZMA_OK) {
+			goto out;
+		}
+	}
+
+out:
+	lzma_end(&strm);
+	free(input);
+	return result;
+}
+#endif
+
+
+
+#ifdef HAVE_ZSTD
+// One frame of a parallel batch
+typedef struct zstd_job {
+	const void *src;
+	size_t src_size;
+	void *dst;
+	size_t dst_size;
+	size_t result;
+} zstd_job_t;
+
+
+
+/**
+ * Worker thread: decompresses one complete frame.
+ */
+static void *zstdWorker(void *arg) {
+	zstd_job_t *job = arg;
+	ZSTD_DCtx *dctx = ZSTD_createDCtx();
+	job->result = dctx == NULL ? (size_t)-1 :
+		ZSTD_decompressDCtx(dctx, job->dst, job->dst_size, job->src,
+				job->src_size);
+	ZSTD_freeDCtx(dctx);
+	return NULL;
+}
+
+
+
+/**
+ * Streams one frame through the ring, reading its input as it goes rather
+ * than waiting for the whole frame, so a trace compressed as one large
+ * frame is decompressed in constant memory.
+ *
+ * @param in The trace
+ * @param stream Decompression context
+ * @param pending Buffer of compressed input, at least INPUT_SIZE bytes;
+ *   the frame starts at *pos
+ * @param pos Read position in pending, left just past the frame
+ * @param len Bytes in pending
+ * @param eof Whether the input is exhausted
+ * @param out Buffer of ZSTD_DStreamOutSize() bytes
+ * @param slot Current ring slot
+ * @param used Bytes already in the current slot
+ * @return 0, or -1 if the frame is corrupt or truncated, or the trace is
+ *   being closed
+ */
+static int zstdStream(trace_input_t *in, ZSTD_DCtx *stream,
+		unsigned char *pending, size_t *pos, size_t *len, int *eof,
+		char *out, char **slot, size_t *used) {
+	size_t ret = 1;
+
+	ZSTD_DCtx_reset(stream, ZSTD_reset_session_only);
+	while (ret != 0) {
+		if (*pos == *len) {
+			if (*eof) {
+				return -1;
+			}
+			ssize_t n = readInput(in, pending, INPUT_SIZE);
+			if (n < 0) {
+				return -1;
+			}
+			*eof = (n == 0);
+			*pos = 0;
+			*len = n;
+			continue;
+		}
+
+		// Decompression stops at the end of the frame, leaving any
+		// following frame in pending
+		ZSTD_inBuffer src = { pending + *pos, *len - *pos, 0 };
+		ZSTD_outBuffer dst = { out, ZSTD_DStreamOutSize(), 0 };
+		ret = ZSTD_decompressStream(stream, &dst, &src);
+		if (ZSTD_isError(ret) || ringWrite(in, slot, used, out, dst.pos)) {
+			return -1;
+		}
+		*pos += src.pos;
+	}
+	return 0;
+}
+
+
+
+/**
+ * Decompresses zstd data. Complete frames that record a size of at most
+ * one ring slot are decompressed in parallel batches; larger frames, and
+ * those without a size, are streamed.
+ *
+ * @param in The trace
+ * @return 0 on success, -1 on error
+ */
+static int decodeZstd(trace_input_t *in) {
+	size_t capacity = 4 * (size_t)INPUT_SIZE, len = 0, pos = 0, used = 0;
+	unsigned char *pending = malloc(capacity);
+	char *out = malloc(ZSTD_DStreamOutSize());
+	ZSTD_DCtx *stream = ZSTD_createDCtx();
+	int eof = 0, result = -1, i;
+	char *slot;
+
+	if (pending == NULL || out == NULL || stream == NULL
+			|| (slot = ringAcquire(in)) == NULL) {
+		goto out;
+	}
+
+	while (!eof || pos < len) {
+		zstd_job_t jobs[ZSTD_THREADS];
+		pthread_t threads[ZSTD_THREADS];
+		unsigned long long size;
+		int batch = 0;
+
+		// Gather complete small frames with a known size
+		while (batch < ZSTD_THREADS && pos < len) {
+			size = ZSTD_getFrameContentSize(pending + pos, len - pos);
+			if (size == ZSTD_CONTENTSIZE_UNKNOWN
+					|| size == ZSTD_CONTENTSIZE_ERROR
+					|| size > RING_SLOT_SIZE) {
+				break;
+			}
+			size_t frame = ZSTD_findFrameCompressedSize(pending + pos,
+					len - pos);
+			if (ZSTD_isError(frame)) {
+				break;
+			}
+			jobs[batch].src = pending + pos;
+			jobs[batch].src_size = frame;
+			jobs[batch].dst_size = size;
+			jobs[batch].dst = malloc(size ? size : 1);
+			if (jobs[batch].dst == NULL) {
+				break;
+			}
+			pos += frame;
+			batch++;
+		}
+
+		if (batch > 0) {
+			int failed = 0;
+			for (i = 0; i < batch; i++) {
+				pthread_create(&threads[i], NULL, zstdWorker, &jobs[i]);
+			}
+			for (i = 0; i < batch; i++) {
+				pthread_join(threads[i], NULL);
+			}
+			for (i = 0; i < batch; i++) {
+				if (ZSTD_isError(jobs[i].result)
+						|| jobs[i].result != jobs[i].dst_size) {
+					failed = 1;
+				} else if (!failed && ringWrite(in, &slot, &used,
+							jobs[i].dst, jobs[i].dst_size)) {
+					failed = 1;
+				}
+				free(jobs[i].dst);
+			}
+			if (failed) {
+				goto out;
+			}
+			continue;
+		}
+
+		// A large frame, or one without a size, is streamed as soon as
+		// its header is in
+		size = pos < len ? ZSTD_getFrameContentSize(pending + pos,
+				len - pos) : ZSTD_CONTENTSIZE_ERROR;
+		if (size != ZSTD_CONTENTSIZE_ERROR
+				&& (size == ZSTD_CONTENTSIZE_UNKNOWN
+					|| size > RING_SLOT_SIZE)) {
+			if (zstdStream(in, stream, pending, &pos, &len, &eof, out,
+						&slot, &used)) {
+				goto out;
+			}
+			continue;
+		}
+
+		// The next small frame, or its header, is incomplete: read more
+		if (eof) {
+			goto out;
+		}
+		if (pos > 0) {
+			memmove(pending, pending + pos, len - pos);
+			len -= pos;
+			pos = 0;
+		}
+		if (capacity - len < INPUT_SIZE) {
+			unsigned char *grown = realloc(pending, capacity * 2);
+			if (grown == NULL) {
+				goto out;
+			}
+			pending = grown;
+			capacity *= 2;
+		}
+		ssize_t n = readInput(in, pending + len, INPUT_SIZE);
+		if (n < 0) {
+			goto out;
+		}
+		eof = (n == 0);
+		len += n;
+	}
+
+	ringCommit(in, used);
+	result = 0;
+
+out:
+	ZSTD_freeDCtx(stream);
+	free(out);
+	free(pending);
+	return result;
+}
+#endif
+
+
+
+/**
+ * Decompression thread.
+ */
+static void *decodeThread(void *arg) {
+	trace_input_t *in = arg;
+	int result = -1;
+
+	switch (in->format) {
+#ifdef HAVE_ZLIB
+		case TRACE_GZIP:
+			result = decodeGzip(in);
+			break;
+#endif
+#ifdef HAVE_LZMA
+		case TRACE_XZ:
+			result = decodeXz(in);
+			break;
+#endif
+#ifdef HAVE_ZSTD
+		case TRACE_ZSTD:
+			result = decodeZstd(in);
+			break;
+#endif
+		default:
+			break;
+	}
+	ringFinish(in, result != 0);
+	return NULL;
+}
+
+
+
+/**
+ * fopencookie read function for a plain stream: the prefix, then the fd.
+ */
+static ssize_t plainRead(void *cookie, char *buf, size_t size) {
+	return readInput(cookie, buf, size);
+}
+
+
+
+/**
+ * fopencookie read function for a compressed trace: drains the ring.
+ */
+static ssize_t ringRead(void *cookie, char *buf, size_t size) {
+	trace_input_t *in = cookie;
+
+	pthread_mutex_lock(&in->lock);
+	while (in->count == 0 && !in->done) {
+		pthread_cond_wait(&in->not_empty, &in->lock);
+	}
+	if (in->count == 0) {
+		int failed = in->failed;
+		pthread_mutex_unlock(&in->lock);
+		if (failed) {
+			errno = EIO;
+			return -1;
+		}
+		return 0;
+	}
+	unsigned int tail = in->tail;
+	pthread_mutex_unlock(&in->lock);
+
+	// The tail slot belongs to the reader until it is released
+	size_t n = in->slot_len[tail] - in->read_pos;
+	if (n > size) {
+		n = size;
+	}
+	memcpy(buf, in->slots[tail] + in->read_pos, n);
+	in->read_pos += n;
+
+	if (in->read_pos == in->slot_len[tail]) {
+		pthread_mutex_lock(&in->lock);
+		in->read_pos = 0;
+		in->tail = (tail + 1) % RING_SLOTS;
+		in->count--;
+		pthread_cond_signal(&in->not_full);
+		pthread_mutex_unlock(&in->lock);
+	}
+	return n;
+}
+
+
+
+/**
+ * fopencookie close function: stops the thread and frees everything.
+ */
+static int inputClose(void *cookie) {
+	trace_input_t *in = cookie;
+	int i;
+
+	if (in->format != TRACE_PLAIN) {
+		pthread_mutex_lock(&in->lock);
+		in->closing = 1;
+		pthread_cond_signal(&in->not_full);
+		pthread_mutex_unlock(&in->lock);
+		pthread_join(in->thread, NULL);
+		for (i = 0; i < RING_SLOTS; i++) {
+			free(in->slots[i]);
+		}
+		pthread_mutex_destroy(&in->lock);
+		pthread_cond_destroy(&in->not_empty);
+		pthread_cond_destroy(&in->not_full);
+	}
+	if (in->fd != STDIN_FILENO) {
+		close(in->fd);
+	}
+	free(in);
+	return 0;
+}
+
+
+
+/**
+ * Works out the format from the first bytes of the trace.
+ */
+static enum trace_format detectFormat(const unsigned char *magic,
+		size_t len) {
+	if (len >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+		return TRACE_GZIP;
+	}
+	if (len >= 6 && !memcmp(magic, "\xfd" "7zXZ\0", 6)) {
+		return TRACE_XZ;
+	}
+	if (len >= 4 && !memcmp(magic, "\x28\xb5\x2f\xfd", 4)) {
+		return TRACE_ZSTD;
+	}
+	return TRACE_PLAIN;
+}
+
+
+
+/**
+ * Whether this build can decompress a format.
+ */
+static int formatSupported(enum trace_format format) {
+	switch (format) {
+		case TRACE_PLAIN:
+			return 1;
+#ifdef HAVE_ZLIB
+		case TRACE_GZIP:
+			return 1;
+#endif
+#ifdef HAVE_LZMA
+		case TRACE_XZ:
+			return 1;
+#endif
+#ifdef HAVE_ZSTD
+		case TRACE_ZSTD:
+			return 1;
+#endif
+		default:
+			return 0;
+	}
+}
+
+
+
+/**
+ * Opens a trace for reading.
+ *
+ * @param path File to open, "-" for stdin
+ * @param seekable Set to whether the stream can be positioned
+ * @param format Set to the detected format
+ * @return A stream of plain trace text, or NULL on error
+ */
+FILE *openTrace(const char *path, int *seekable, enum trace_format *format) {
+	int from_stdin = !strcmp(path, "-");
+	int fd = from_stdin ? STDIN_FILENO : open(path, O_RDONLY);
+	int i;
+
+	if (fd < 0) {
+		return NULL;
+	}
+
+	trace_input_t *in = calloc(1, sizeof(trace_input_t));
+	if (in == NULL) {
+		if (!from_stdin) {
+			close(fd);
+		}
+		return NULL;
+	}
+	in->fd = fd;
+
+	// Reading the magic bytes; a short trace may have fewer
+	while (in->prefix_len < MAGIC_MAX) {
+		ssize_t n = read(fd, in->prefix + in->prefix_len,
+				MAGIC_MAX - in->prefix_len);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			break;
+		}
+		in->prefix_len += n;
+	}
+	in->format = detectFormat(in->prefix, in->prefix_len);
+	*format = in->format;
+	*seekable = 0;
+
+	if (!formatSupported(in->format)) {
+		if (!from_stdin) {
+			close(fd);
+		}
+		free(in);
+		return NULL;
+	}
+
+	// A plain file goes straight to stdio if it can be rewound
+	if (in->format == TRACE_PLAIN && !from_stdin
+			&& lseek(fd, 0, SEEK_SET) == 0) {
+		free(in);
+		*seekable = 1;
+		return fdopen(fd, "r");
+	}
+
+	cookie_io_functions_t io = { NULL, NULL, NULL, inputClose };
+	if (in->format == TRACE_PLAIN) {
+		io.read = plainRead;
+		return fopencookie(in, "r", io);
+	}
+
+	// Compressed: start the decompression thread
+	for (i = 0; i < RING_SLOTS; i++) {
+		in->slots[i] = malloc(RING_SLOT_SIZE);
+		if (in->slots[i] == NULL) {
+			while (i-- > 0) {
+				free(in->slots[i]);
+			}
+			close(fd);
+			free(in);
+			return NULL;
+		}
+	}
+	pthread_mutex_init(&in->lock, NULL);
+	pthread_cond_init(&in->not_empty, NULL);
+	pthread_cond_init(&in->not_full, NULL);
+	pthread_create(&in->thread, NULL, decodeThread, in);
+
+	io.read = ringRead;
+	return fopencookie(in, "r", io);
+}
+
+
+
+/**
+ * Closes a trace opened with openTrace.
+ *
+ * @param fp The stream
+ */
+void closeTrace(FILE *fp) {
+	fclose(fp);
+}
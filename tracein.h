@@ -0,0 +1,31 @@
+/*
+ * tracein.h - Opening traces: plain files, stdin, pipes and compressed
+ */
+
+#ifndef CSIM_TRACEIN_H
+#define CSIM_TRACEIN_H
+
+#include <stdio.h>
+
+// Formats recognised from the first bytes of a trace
+enum trace_format {
+	TRACE_PLAIN,
+	TRACE_GZIP,
+	TRACE_XZ,
+	TRACE_ZSTD
+};
+
+/*
+ * openTrace - Open path ("-" for stdin) for reading. Compressed traces are
+ *     detected by their magic bytes and decompressed on a separate thread;
+ *     the returned stream always yields plain trace text. Sets *seekable to
+ *     whether the stream may be positioned with fseek, and *format to what
+ *     was detected. Returns NULL on error, or if the trace is compressed
+ *     in a format this build has no library for.
+ */
+FILE *openTrace(const char *path, int *seekable, enum trace_format *format);
+
+/* Close a stream from openTrace and stop its decompression thread */
+void closeTrace(FILE *fp);
+
+#endif /* CSIM_TRACEIN_H */
@@ -0,0 +1,199 @@
+/*
+ * tracetrans.c
+ *
+ * Evaluates the transpose functions registered in trans.c against the cache
+ * model directly, without capturing a valgrind trace to a file and replaying
+ * it through csim.
+ *
+ * trans.c is compiled with GCC's kernel address sanitizer instrumentation in
+ * callback mode, which turns every load and store it makes into a call to
+ * __asan_{load,store}N_noabort(addr). Those callbacks are defined here and
+ * feed the accesses that fall inside A or B into the cache, so each function
+ * runs natively while its memory accesses are simulated.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include "cachelab.h"
+#include "cache.h"
+
+// Distance between A and B, in ints, for matrices up to 256x256. Matches
+// test-trans, where A and B are adjacent int[256][256] globals.
+#define MATRIX_STRIDE (256 * 256)
+
+// Alignment of the matrices, so set mapping doesn't depend on malloc
+#define MATRIX_ALIGN 4096
+
+void registerFunctions();
+
+// The cache the current function is run against
+static Set *cache = NULL;
+static int set_bits, block_bits, lines_per_set;
+static int hit_count, miss_count, eviction_count;
+
+// Accesses are only simulated while a function runs and only inside A and B
+static int tracing = 0;
+static mem_addr region_start, region_end;
+
+
+
+/**
+ * Prints out a reminder of how to run the program.
+ *
+ * @param executable_name String containing the name of the executable.
+ */
+void usage(char *executable_name) {
+	printf("Usage: %s -M <cols> -N <rows> [-s <s>] [-E <E>] [-b <b>]\n",
+		   	executable_name);
+}
+
+
+
+/**
+ * Feeds one access made by the function under test into the cache.
+ *
+ * @param operation 'L' or 'S'
+ * @param address Memory location of the access
+ * @param size Number of bytes accessed
+ */
+static void simulateAccess(char operation, mem_addr address, int size) {
+	if (!tracing || address < region_start || address >= region_end) {
+		return;
+	}
+
+	cacheAccess(cache, set_bits, block_bits, lines_per_set, operation,
+			address, size, &hit_count, &miss_count, &eviction_count);
+}
+
+// Sanitizer callbacks emitted by -fsanitize=kernel-address in trans.c
+#define ACCESS_CALLBACKS(n) \
+	void __asan_load##n##_noabort(unsigned long addr); \
+	void __asan_store##n##_noabort(unsigned long addr); \
+	void __asan_load##n##_noabort(unsigned long addr) { \
+		simulateAccess('L', addr, n); \
+	} \
+	void __asan_store##n##_noabort(unsigned long addr) { \
+		simulateAccess('S', addr, n); \
+	}
+
+ACCESS_CALLBACKS(1)
+ACCESS_CALLBACKS(2)
+ACCESS_CALLBACKS(4)
+ACCESS_CALLBACKS(8)
+ACCESS_CALLBACKS(16)
+
+void __asan_loadN_noabort(unsigned long addr, unsigned long size);
+void __asan_storeN_noabort(unsigned long addr, unsigned long size);
+void __asan_loadN_noabort(unsigned long addr, unsigned long size) {
+	simulateAccess('L', addr, (int)size);
+}
+void __asan_storeN_noabort(unsigned long addr, unsigned long size) {
+	simulateAccess('S', addr, (int)size);
+}
+void __asan_handle_no_return(void);
+void __asan_handle_no_return(void) {
+}
+
+
+
+/**
+ * Main function of program. Runs every registered transpose function on a
+ * fresh cache and reports its hits, misses and evictions.
+ *
+ * @param argc Number of arguments from the command line
+ * @param argv Arguments from the command line
+ */
+int main(int argc, char *argv[]) {
+	int M = 0, N = 0;
+	int c, i;
+
+	// Defaults are the cache lab's 1KB direct mapped cache
+	set_bits = 5;
+	lines_per_set = 1;
+	block_bits = 5;
+
+	while ((c = getopt(argc, argv, "hM:N:s:E:b:")) != -1) {
+		switch (c) {
+			case 'M':
+				M = strtol(optarg, NULL, 10);
+				break;
+			case 'N':
+				N = strtol(optarg, NULL, 10);
+				break;
+			case 's':
+				set_bits = strtol(optarg, NULL, 10);
+				break;
+			case 'E':
+				lines_per_set = strtol(optarg, NULL, 10);
+				break;
+			case 'b':
+				block_bits = strtol(optarg, NULL, 10);
+				break;
+			default:
+				usage(argv[0]);
+				exit(1);
+		}
+	}
+
+	if (M <= 0 || N <= 0 || lines_per_set <= 0) {
+		usage(argv[0]);
+		exit(1);
+	}
+
+	// A and B share one allocation laid out like test-trans's globals
+	size_t stride = MATRIX_STRIDE;
+	if ((size_t)M * N > stride) {
+		stride = ((size_t)M * N + MATRIX_STRIDE - 1) / MATRIX_STRIDE
+			* MATRIX_STRIDE;
+	}
+	int *matrices = aligned_alloc(MATRIX_ALIGN, 2 * stride * sizeof(int));
+	int *expected = malloc((size_t)M * N * sizeof(int));
+	if (matrices == NULL || expected == NULL) {
+		printf("Error allocating matrices\n");
+		exit(1);
+	}
+	int (*A)[M] = (int (*)[M])matrices;
+	int (*B)[N] = (int (*)[N])(matrices + stride);
+	int (*C)[N] = (int (*)[N])expected;
+
+	region_start = (mem_addr)A;
+	region_end = (mem_addr)(matrices + stride + (size_t)M * N);
+
+	registerFunctions();
+
+	for (i = 0; i < func_counter; i++) {
+		trans_func_t *f = &func_list[i];
+
+		initMatrix(M, N, A, B);
+		correctTrans(M, N, A, C);
+
+		cache = createCache(1 << set_bits, lines_per_set);
+		if (cache == NULL) {
+			printf("Error allocating cache\n");
+			exit(1);
+		}
+		hit_count = miss_count = eviction_count = 0;
+
+		tracing = 1;
+		(*f->func_ptr)(M, N, A, B);
+		tracing = 0;
+
+		f->correct = !memcmp(B, C, (size_t)M * N * sizeof(int));
+		f->num_hits = hit_count;
+		f->num_misses = miss_count;
+		f->num_evictions = eviction_count;
+		freeCache(cache, 1 << set_bits);
+
+		printf("Function %d (%s): %s\n", i, f->description,
+				f->correct ? "correct" : "INCORRECT");
+		printf("  hits:%u misses:%u evictions:%u\n", f->num_hits,
+				f->num_misses, f->num_evictions);
+	}
+
+	free(expected);
+	free(matrices);
+	return 0;
+}
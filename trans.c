@@ -0,0 +1,85 @@
+/*
+ * trans.c - Matrix transpose B = A^T
+ *
+ * Each transpose function has a prototype of the form:
+ * void trans(int M, int N, int A[N][M], int B[M][N]);
+ *
+ * The functions are registered in registerFunctions() and evaluated by
+ * tracetrans, which counts the misses they cause on a simulated cache.
+ */
+
+#include <stdio.h>
+#include "cachelab.h"
+
+/* Tile edge used by transpose_submit */
+#define TILE 8
+
+
+
+/**
+ * Blocked transpose. The diagonal element of each row of a diagonal tile is
+ * written last so it doesn't evict the row of A that is still being read.
+ *
+ * @param M Number of columns of A
+ * @param N Number of rows of A
+ * @param A Source matrix
+ * @param B Destination matrix
+ */
+char transpose_submit_desc[] = "Transpose submission";
+void transpose_submit(int M, int N, int A[N][M], int B[M][N])
+{
+    int ii, jj, i, j, tmp, diag;
+
+    for (ii = 0; ii < N; ii += TILE) {
+        for (jj = 0; jj < M; jj += TILE) {
+            for (i = ii; i < ii + TILE && i < N; i++) {
+                diag = -1;
+                for (j = jj; j < jj + TILE && j < M; j++) {
+                    if (i == j) {
+                        diag = j;
+                    } else {
+                        B[j][i] = A[i][j];
+                    }
+                }
+                if (diag >= 0) {
+                    tmp = A[i][diag];
+                    B[diag][i] = tmp;
+                }
+            }
+        }
+    }
+}
+
+
+
+/**
+ * Simple baseline transpose, not optimized for the cache.
+ *
+ * @param M Number of columns of A
+ * @param N Number of rows of A
+ * @param A Source matrix
+ * @param B Destination matrix
+ */
+char trans_desc[] = "Simple row-wise scan transpose";
+void trans(int M, int N, int A[N][M], int B[M][N])
+{
+    int i, j, tmp;
+
+    for (i = 0; i < N; i++) {
+        for (j = 0; j < M; j++) {
+            tmp = A[i][j];
+            B[j][i] = tmp;
+        }
+    }
+}
+
+
+
+/**
+ * Registers the transpose functions to be evaluated.
+ */
+void registerFunctions()
+{
+    registerTransFunction(transpose_submit, transpose_submit_desc);
+    registerTransFunction(trans, trans_desc);
+}